@@ -0,0 +1,158 @@
+/*
+   Copyright (c) 2015, 2016, 2020, 2023, 2024 Andreas F. Borchert
+   All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+   KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+   WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+
+/*
+   microbenchmarks for "printf.hpp" which compare fmt::snprintf
+   (and fmt::printf for wide streams) against the std::snprintf
+   family for the hot conversion classes; every case reports
+   ns per call and MB per second; build and run with
+
+      make benchmark && ./benchmark
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cwchar>
+#include <sstream>
+#include "printf.hpp"
+
+static long consumed = 0; /* defeats optimizing the measured calls away */
+
+struct measurement {
+   double ns_per_call;
+   double mb_per_sec;
+};
+
+/* run body until we have a measurement interval of at least 0.2 s;
+   body is expected to return the number of characters generated */
+template<typename Body>
+measurement measure(Body&& body) {
+   using namespace std::chrono;
+   long reps = 1;
+   for (;;) {
+      long chars = 0;
+      auto t0 = steady_clock::now();
+      for (long i = 0; i < reps; ++i) {
+	 chars += body(i);
+      }
+      auto ns = duration_cast<nanoseconds>(steady_clock::now() - t0).count();
+      consumed += chars;
+      if (ns >= 200000000L) {
+	 measurement m;
+	 m.ns_per_call = static_cast<double>(ns) / reps;
+	 m.mb_per_sec = chars * (1e9 / 1e6) / ns;
+	 return m;
+      }
+      reps *= 4;
+   }
+}
+
+template<typename FmtBody, typename StdBody>
+void run_case(const char* name, FmtBody&& fmt_body, StdBody&& std_body) {
+   auto fmt_m = measure(fmt_body);
+   auto std_m = measure(std_body);
+   fmt::printf("%-20s fmt: %8.1f ns/call %8.1f MB/s"
+      "   std: %8.1f ns/call %8.1f MB/s\n",
+      name, fmt_m.ns_per_call, fmt_m.mb_per_sec,
+      std_m.ns_per_call, std_m.mb_per_sec);
+}
+
+#if defined(__GNUC__)
+/* the positional baseline uses the POSIX %n$ extension
+   which -pedantic would otherwise flag */
+#pragma GCC diagnostic ignored "-Wformat"
+#endif
+
+int main() {
+   char buf[256];
+   constexpr auto bufsize = sizeof buf;
+
+   run_case("literal",
+      [&](long) {
+	 return fmt::snprintf(buf, bufsize,
+	    "The quick brown fox jumps over the lazy dog"
+	    " while nobody is converted here at all\n");
+      },
+      [&](long) {
+	 return std::snprintf(buf, bufsize, "%s",
+	    "The quick brown fox jumps over the lazy dog"
+	    " while nobody is converted here at all\n");
+      });
+   run_case("%d/%x columns",
+      [&](long i) {
+	 return fmt::snprintf(buf, bufsize, "%8d %8x %8d %8x\n",
+	    static_cast<int>(i), static_cast<unsigned>(i),
+	    static_cast<int>(-i), static_cast<unsigned>(i * 7));
+      },
+      [&](long i) {
+	 return std::snprintf(buf, bufsize, "%8d %8x %8d %8x\n",
+	    static_cast<int>(i), static_cast<unsigned>(i),
+	    static_cast<int>(-i), static_cast<unsigned>(i * 7));
+      });
+   run_case("%f/%g",
+      [&](long i) {
+	 return fmt::snprintf(buf, bufsize, "%12.6f %g\n",
+	    i * 1.25, i * 0.001953125);
+      },
+      [&](long i) {
+	 return std::snprintf(buf, bufsize, "%12.6f %g\n",
+	    i * 1.25, i * 0.001953125);
+      });
+   run_case("%s width/precision",
+      [&](long) {
+	 return fmt::snprintf(buf, bufsize, "%-16.8s|%16s|\n",
+	    "truncate me here", "right");
+      },
+      [&](long) {
+	 return std::snprintf(buf, bufsize, "%-16.8s|%16s|\n",
+	    "truncate me here", "right");
+      });
+   run_case("positional",
+      [&](long i) {
+	 return fmt::snprintf(buf, bufsize, "%2$s = %1$08d\n",
+	    static_cast<int>(i), "counter");
+      },
+      [&](long i) {
+	 return std::snprintf(buf, bufsize, "%2$s = %1$08d\n",
+	    static_cast<int>(i), "counter");
+      });
+
+   /* wide streams; std::swprintf serves as baseline */
+   std::wostringstream wos;
+   wchar_t wbuf[256];
+   run_case("wide %d %ls",
+      [&](long i) {
+	 wos.str(L"");
+	 return fmt::printf(wos, L"%8d %ls\n",
+	    static_cast<int>(i), L"wide string");
+      },
+      [&](long i) {
+	 return std::swprintf(wbuf, sizeof wbuf/sizeof wbuf[0],
+	    L"%8d %ls\n", static_cast<int>(i), L"wide string");
+      });
+
+   if (consumed == 42) fmt::printf("\n"); /* keep the results alive */
+   return 0;
+}
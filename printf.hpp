@@ -44,6 +44,9 @@
       std::snprintf(s, n, ...)    by        fmt::snprintf(s, n, ...)
       std::wprintf(...)           by        fmt::printf(...)
 
+   In addition, fmt::sprintf(format, ...) delivers the formatted
+   text as std::string (or std::wstring for wide formats).
+
    where out is an ostream, not a FILE*. As fmt::printf is
    based on variadic template constructs of C++11, this
    is possible in a typesafe way. Consequently, it no
@@ -121,24 +124,43 @@
 ISO C++ 2011 standard.
 #else
 
+#include <atomic>
 #include <cassert>
 #include <cerrno>
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
 #include <climits>
 #include <cmath>
+#include <condition_variable>
 #include <cstdint>
 #include <cstring>
 #include <cwchar>
 #include <cwctype>
+#include <deque>
 #include <exception>
 #include <iomanip>
 #include <iostream>
 #include <limits>
 #include <locale>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <streambuf>
 #include <string>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+#include <thread>
 #include <tuple>
 #include <type_traits>
+#include <unordered_map>
+#include <vector>
+#if defined(__unix__)
+#include <sys/uio.h> /* for the writev-based fmt::dprintf */
+#endif
 
 /* avoid warnings for fallthroughs */
 #if __cplusplus >= 201703L
@@ -154,10 +176,49 @@ ISO C++ 2011 standard.
    #endif
 #endif
 
+/* format parsing is done in constexpr functions whenever the
+   relaxed constexpr rules of C++14 are available; this allows
+   formats to be parsed and checked at compile time */
+#if __cplusplus >= 201402L
+   #define FMT_PRINTF_CONSTEXPR constexpr
+#else
+   #define FMT_PRINTF_CONSTEXPR inline
+#endif
+
 namespace fmt {
 
+/* per-thread counters of the opt-in instrumentation layer which
+   is enabled by compiling with -DFMT_PRINTF_STATS; a snapshot is
+   delivered by fmt::stats() below; without the macro all counting
+   code vanishes and fmt::stats() delivers zeroes */
+struct printf_stats {
+   /* invocations by conversion class */
+   unsigned long long integer_conversions;
+   unsigned long long float_conversions;
+   unsigned long long string_conversions;
+   unsigned long long char_conversions;
+   unsigned long long other_conversions;
+   /* format segments processed at runtime */
+   unsigned long long segments_processed;
+   /* bytes pushed into the underlying streambufs */
+   unsigned long long bytes_written;
+   /* heap blocks drawn by the per-thread arena */
+   unsigned long long arena_allocations;
+};
+
 namespace impl {
 
+#if defined(FMT_PRINTF_STATS)
+inline printf_stats& stats_counters() {
+   thread_local printf_stats counters = printf_stats();
+   return counters;
+}
+#define FMT_PRINTF_COUNT(field, nbytes) \
+   (static_cast<void>(fmt::impl::stats_counters().field += (nbytes)))
+#else
+#define FMT_PRINTF_COUNT(field, nbytes) (static_cast<void>(0))
+#endif
+
 /* type trait to recognize encoded character types which can be distinguished
    from regular numerical types, see also [iosfwd.syn]
 */
@@ -170,17 +231,135 @@ template<> struct is_char<wchar_t> : public std::true_type {};
 template<> struct is_char<char16_t> : public std::true_type {};
 template<> struct is_char<char32_t> : public std::true_type {};
 
+/* type trait to recognize string types of encoded character types
+   which enjoy dedicated size-aware print_value overloads */
+template<typename T> struct is_string : public std::false_type {};
+template<typename Value, typename Traits, typename Alloc>
+struct is_string<std::basic_string<Value, Traits, Alloc>> :
+   public is_char<Value> {};
+#if __cplusplus >= 201703L
+template<typename Value, typename Traits>
+struct is_string<std::basic_string_view<Value, Traits>> :
+   public is_char<Value> {};
+#endif
+
+/* per-thread arena for transient formatting buffers; the arena
+   converges to the high-water mark of its thread and is reset
+   when the outermost fmt::printf-style call returns such that
+   steady-state workloads stop hitting the heap allocator */
+class scratch_arena {
+   public:
+      static scratch_arena& instance() {
+	 thread_local scratch_arena arena;
+	 return arena;
+      }
+      void* allocate(std::size_t nbytes) {
+	 constexpr std::size_t alignment = alignof(long double);
+	 nbytes = (nbytes + alignment - 1) / alignment * alignment;
+	 if (blocks.empty() || used + nbytes > blocks.back().size) {
+	    /* grow geometrically; earlier blocks stay alive as
+	       buffers handed out from them may still be in use */
+	    std::size_t size = blocks.empty()? min_block_size:
+	       blocks.back().size * 2;
+	    if (size < nbytes) size = nbytes;
+	    blocks.emplace_back(size);
+	    FMT_PRINTF_COUNT(arena_allocations, 1);
+	    used = 0;
+	 }
+	 char* p = blocks.back().storage.get() + used;
+	 used += nbytes;
+	 return p;
+      }
+      void enter() {
+	 ++depth;
+      }
+      void leave() {
+	 if (--depth > 0) return;
+	 if (blocks.size() > 1) {
+	    /* consolidate such that future calls of this size
+	       are served from one block without allocating */
+	    std::size_t total = 0;
+	    for (const auto& b: blocks) total += b.size;
+	    blocks.clear();
+	    blocks.emplace_back(total);
+	 }
+	 used = 0;
+      }
+   private:
+      struct block {
+	 explicit block(std::size_t size) :
+	    storage(new char[size]), size(size) {
+	 }
+	 std::unique_ptr<char[]> storage;
+	 std::size_t size;
+      };
+      static constexpr std::size_t min_block_size = 1024;
+      std::vector<block> blocks;
+      std::size_t used = 0;
+      unsigned int depth = 0;
+};
+
+/* RAII marker for one top-level call; when the outermost guard
+   goes out of scope the arena of this thread is reset */
+struct scratch_guard {
+   scratch_guard() {
+      scratch_arena::instance().enter();
+   }
+   ~scratch_guard() {
+      scratch_arena::instance().leave();
+   }
+};
+
+/* typed view into the per-thread arena; the buffer stays valid
+   until the outermost call returns, nothing is to be freed */
+template<typename T>
+class scratch_buffer {
+   public:
+      explicit scratch_buffer(std::size_t count) :
+	 ptr(static_cast<T*>(
+	    scratch_arena::instance().allocate(count * sizeof(T)))) {
+      }
+      T* data() {
+	 return ptr;
+      }
+   private:
+      T* ptr;
+};
+
 /* printf is expected to return the number of bytes written;
    the following extensions direct all output to the given
-   output stream and count all bytes written */
+   output stream and count all bytes written;
+   the output is accumulated in an internal buffer such that
+   segment texts, conversions, and padding reach the underlying
+   streambuf in large batches instead of one virtual call per
+   write or even per character */
 template<typename CharT, typename Traits = std::char_traits<CharT>>
 class counting_ostreambuf : public std::basic_streambuf<CharT, Traits> {
    public:
       counting_ostreambuf(std::basic_streambuf<CharT, Traits>& sbuf) :
-	 sbuf(sbuf) {
+	    sbuf(sbuf) {
+	 this->setp(buffer, buffer + buffer_size);
+      }
+      ~counting_ostreambuf() {
+	 flush_buffer(); /* errors can no longer be reported here */
       }
       std::streamsize get_count() const {
-	 return nbytes;
+	 return nbytes + pending();
+      }
+      /* forward the internally buffered output to the underlying
+	 streambuf without propagating a sync */
+      bool flush_buffer() {
+	 std::streamsize count = pending();
+	 if (count > 0) {
+	    std::streamsize written = sbuf.sputn(this->pbase(), count);
+	    if (written > 0) {
+	       nbytes += written;
+	       FMT_PRINTF_COUNT(bytes_written, written);
+	    }
+	    this->pbump(-static_cast<int>(count));
+	    if (written != count) return false;
+	 }
+	 return true;
       }
    protected:
       using Base = std::basic_streambuf<CharT, Traits>;
@@ -190,8 +369,24 @@ class counting_ostreambuf : public std::basic_streambuf<CharT, Traits> {
 
       virtual std::streamsize xsputn(const char_type* s,
 	    std::streamsize count) {
+	 std::streamsize avail = this->epptr() - this->pptr();
+	 if (count <= avail) {
+	    traits_type::copy(this->pptr(), s, count);
+	    this->pbump(static_cast<int>(count));
+	    return count;
+	 }
+	 if (!flush_buffer()) return 0;
+	 if (count < buffer_size) {
+	    traits_type::copy(this->pptr(), s, count);
+	    this->pbump(static_cast<int>(count));
+	    return count;
+	 }
+	 /* large writes bypass the internal buffer */
 	 std::streamsize result = sbuf.sputn(s, count);
-	 if (result > 0) nbytes += result;
+	 if (result > 0) {
+	    nbytes += result;
+	    FMT_PRINTF_COUNT(bytes_written, result);
+	 }
 	 return result;
       }
       virtual int_type overflow(int_type ch) {
@@ -199,17 +394,26 @@ class counting_ostreambuf : public std::basic_streambuf<CharT, Traits> {
 	    https://stackoverflow.com/questions/10921761/extending-c-ostream */
 	 if (ch == traits_type::eof()) {
 	    return traits_type::eof();
-	 } else {
-	    char_type c = traits_type::to_char_type(ch);
-	    return xsputn(&c, 1) == 1? ch: traits_type::eof();
 	 }
+	 if (this->pptr() == this->epptr() && !flush_buffer()) {
+	    return traits_type::eof();
+	 }
+	 *this->pptr() = traits_type::to_char_type(ch);
+	 this->pbump(1);
+	 return ch;
       }
       virtual int sync() {
+	 if (!flush_buffer()) return -1;
 	 return sbuf.pubsync();
       }
    private:
+      std::streamsize pending() const {
+	 return this->pptr() - this->pbase();
+      }
+      static constexpr std::streamsize buffer_size = 256;
       std::basic_streambuf<CharT, Traits>& sbuf;
       std::streamsize nbytes = 0;
+      CharT buffer[buffer_size];
 };
 
 template<typename CharT, typename Traits = std::char_traits<CharT>>
@@ -224,15 +428,67 @@ class counting_ostream : public std::basic_ostream<CharT, Traits> {
       std::streamsize get_count() const {
 	 return sbuf.get_count();
       }
+      /* push out the internally buffered output;
+	 in case of failures the badbit is set */
+      void flush_buffer() {
+	 if (!sbuf.flush_buffer()) {
+	    this->setstate(std::ios_base::badbit);
+	 }
+      }
    private:
       counting_ostreambuf<CharT, Traits> sbuf;
 };
 
+/* streambuf that writes into a fixed caller-supplied buffer;
+   output beyond the capacity of the buffer is accepted but
+   discarded such that the counting machinery above still
+   delivers the number of bytes that would have been written;
+   this allows fmt::snprintf to format directly into the
+   target buffer without any allocations */
 template<typename CharT, typename Traits = std::char_traits<CharT>>
-class uppercase_ostreambuf : public std::basic_streambuf<CharT, Traits> {
+class fixed_ostreambuf : public std::basic_streambuf<CharT, Traits> {
    public:
-      uppercase_ostreambuf(std::basic_streambuf<CharT, Traits>& sbuf) :
-	 sbuf(sbuf) {
+      fixed_ostreambuf(CharT* s, std::size_t n) {
+	 if (s && n > 0) {
+	    this->setp(s, s + n);
+	 }
+      }
+      std::streamsize stored() const {
+	 return this->pptr() - this->pbase();
+      }
+   protected:
+      using Base = std::basic_streambuf<CharT, Traits>;
+      using char_type = typename Base::char_type;
+      using int_type = typename Base::int_type;
+      using traits_type = typename Base::traits_type;
+
+      virtual std::streamsize xsputn(const char_type* s,
+	    std::streamsize count) {
+	 std::streamsize avail = this->epptr() - this->pptr();
+	 if (avail > count) avail = count;
+	 if (avail > 0) {
+	    traits_type::copy(this->pptr(), s, avail);
+	    this->pbump(static_cast<int>(avail));
+	 }
+	 return count;
+      }
+      virtual int_type overflow(int_type ch) {
+	 /* the buffer is full, the excess is discarded */
+	 return traits_type::not_eof(ch);
+      }
+};
+
+/* streambuf that forwards all output to an output iterator;
+   this allows fmt::format_to to format into preallocated
+   buffers or arbitrary character sinks without allocations */
+template<typename OutputIt, typename CharT,
+   typename Traits = std::char_traits<CharT>>
+class iterator_ostreambuf : public std::basic_streambuf<CharT, Traits> {
+   public:
+      explicit iterator_ostreambuf(OutputIt it) : it(it) {
+      }
+      OutputIt get_iterator() const {
+	 return it;
       }
    protected:
       using Base = std::basic_streambuf<CharT, Traits>;
@@ -243,16 +499,156 @@ class uppercase_ostreambuf : public std::basic_streambuf<CharT, Traits> {
       virtual std::streamsize xsputn(const char_type* s,
 	    std::streamsize count) {
 	 for (std::streamsize i = 0; i < count; ++i) {
-	    char_type ch = s[i];
-	    if (std::islower(ch, this->getloc())) {
-	       ch = std::toupper(ch, this->getloc());
-	    }
-	    if (sbuf.sputc(ch) == traits_type::eof()) {
-	       return i;
-	    }
+	    *it = s[i]; ++it;
+	 }
+	 return count;
+      }
+      virtual int_type overflow(int_type ch) {
+	 if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+	    *it = traits_type::to_char_type(ch); ++it;
+	 }
+	 return traits_type::not_eof(ch);
+      }
+   private:
+      OutputIt it;
+};
+
+/* streambuf that collects all output into a std::basic_string;
+   results of up to N characters are assembled in an internal
+   buffer and moved into the string just once such that
+   fmt::sprintf and fmt::memory_stream avoid the allocations
+   of an ostringstream for typical short results */
+template<typename CharT, typename Traits = std::char_traits<CharT>,
+   std::size_t N = 128>
+class string_ostreambuf : public std::basic_streambuf<CharT, Traits> {
+   public:
+      string_ostreambuf() {
+	 this->setp(buffer, buffer + buffer_size);
+      }
+      /* reuse the capacity of a recycled string */
+      explicit string_ostreambuf(std::basic_string<CharT, Traits>&& recycled) :
+	    result(std::move(recycled)) {
+	 result.clear();
+	 this->setp(buffer, buffer + buffer_size);
+      }
+      std::basic_string<CharT, Traits> str() {
+	 spill();
+	 return std::move(result);
+      }
+      /* allocation-free access to the collected text as long as
+	 it fits into the internal buffer; the pointer remains
+	 valid until the next output operation */
+      const CharT* data() {
+	 if (result.empty()) {
+	    return this->pbase();
+	 }
+	 spill();
+	 return result.data();
+      }
+      std::size_t size() const {
+	 return result.size() + (this->pptr() - this->pbase());
+      }
+   protected:
+      using Base = std::basic_streambuf<CharT, Traits>;
+      using char_type = typename Base::char_type;
+      using int_type = typename Base::int_type;
+      using traits_type = typename Base::traits_type;
+
+      virtual std::streamsize xsputn(const char_type* s,
+	    std::streamsize count) {
+	 std::streamsize avail = this->epptr() - this->pptr();
+	 if (count <= avail) {
+	    traits_type::copy(this->pptr(), s, count);
+	    this->pbump(static_cast<int>(count));
+	 } else {
+	    spill();
+	    result.append(s, count);
 	 }
 	 return count;
       }
+      virtual int_type overflow(int_type ch) {
+	 if (ch == traits_type::eof()) {
+	    return traits_type::eof();
+	 }
+	 if (this->pptr() == this->epptr()) {
+	    spill();
+	 }
+	 *this->pptr() = traits_type::to_char_type(ch);
+	 this->pbump(1);
+	 return ch;
+      }
+   private:
+      void spill() {
+	 std::streamsize count = this->pptr() - this->pbase();
+	 if (count > 0) {
+	    result.append(this->pbase(), count);
+	    this->pbump(-static_cast<int>(count));
+	 }
+      }
+      static constexpr std::streamsize buffer_size = N;
+      std::basic_string<CharT, Traits> result;
+      CharT buffer[buffer_size];
+};
+
+/* deliver a 256-entry uppercase translation table for the given
+   locale; per-character std::toupper calls go through the ctype
+   facet and are surprisingly expensive, hence the table is built
+   once per thread and rebuilt only when the locale changes */
+inline const char* uppercase_table(const std::locale& loc) {
+   thread_local std::locale cached_base;
+   thread_local char table[256];
+   thread_local bool built = false;
+   if (!built || !(cached_base == loc)) {
+      auto& ct = std::use_facet<std::ctype<char>>(loc);
+      for (int i = 0; i < 256; ++i) {
+	 table[i] = ct.toupper(static_cast<char>(i));
+      }
+      cached_base = loc;
+      built = true;
+   }
+   return table;
+}
+
+/* deliver a 256-entry widening table for the given locale;
+   per-character out.widen calls go through the ctype facet and
+   are the dominant cost of widening char payloads onto wide
+   streams, hence the table is built once per thread through the
+   bulk widen API and rebuilt only when the locale changes */
+template<typename CharT>
+inline const CharT* widening_table(const std::locale& loc) {
+   thread_local std::locale cached_base;
+   thread_local CharT table[256];
+   thread_local bool built = false;
+   if (!built || !(cached_base == loc)) {
+      char from[256];
+      for (int i = 0; i < 256; ++i) {
+	 from[i] = static_cast<char>(i);
+      }
+      auto& ct = std::use_facet<std::ctype<CharT>>(loc);
+      ct.widen(from, from + 256, table);
+      cached_base = loc;
+      built = true;
+   }
+   return table;
+}
+
+template<typename CharT, typename Traits = std::char_traits<CharT>>
+class uppercase_ostreambuf : public std::basic_streambuf<CharT, Traits> {
+   public:
+      uppercase_ostreambuf(std::basic_streambuf<CharT, Traits>& sbuf) :
+	 sbuf(sbuf) {
+      }
+   protected:
+      using Base = std::basic_streambuf<CharT, Traits>;
+      using char_type = typename Base::char_type;
+      using int_type = typename Base::int_type;
+      using traits_type = typename Base::traits_type;
+
+      virtual std::streamsize xsputn(const char_type* s,
+	    std::streamsize count) {
+	 return transform_and_forward(s, count,
+	    std::is_same<CharT, char>());
+      }
 
       virtual int_type overflow(int_type ch) {
 	 if (ch == traits_type::eof()) {
@@ -266,6 +662,40 @@ class uppercase_ostreambuf : public std::basic_streambuf<CharT, Traits> {
 	 return sbuf.pubsync();
       }
    private:
+      /* table-driven bulk translation for plain chars */
+      std::streamsize transform_and_forward(const char_type* s,
+	    std::streamsize count, std::true_type) {
+	 const char* table = uppercase_table(this->getloc());
+	 char buf[chunk_size];
+	 std::streamsize done = 0;
+	 while (done < count) {
+	    std::streamsize chunk = count - done;
+	    if (chunk > chunk_size) chunk = chunk_size;
+	    for (std::streamsize i = 0; i < chunk; ++i) {
+	       buf[i] = table[static_cast<unsigned char>(s[done + i])];
+	    }
+	    if (sbuf.sputn(buf, chunk) != chunk) return done;
+	    done += chunk;
+	 }
+	 return count;
+      }
+      /* facet-driven range translation for wide characters */
+      std::streamsize transform_and_forward(const char_type* s,
+	    std::streamsize count, std::false_type) {
+	 auto& ct = std::use_facet<std::ctype<CharT>>(this->getloc());
+	 CharT buf[chunk_size];
+	 std::streamsize done = 0;
+	 while (done < count) {
+	    std::streamsize chunk = count - done;
+	    if (chunk > chunk_size) chunk = chunk_size;
+	    traits_type::copy(buf, s + done, chunk);
+	    ct.toupper(buf, buf + chunk);
+	    if (sbuf.sputn(buf, chunk) != chunk) return done;
+	    done += chunk;
+	 }
+	 return count;
+      }
+      static constexpr std::streamsize chunk_size = 256;
       std::basic_streambuf<CharT, Traits>& sbuf;
 };
 
@@ -300,19 +730,76 @@ struct suppress_grouping : std::numpunct<char> {
    }
 };
 
-/* RAII object that saves the current formatting state of the stream
-   and makes sure that the state is restored on destruction */
+/* deliver a locale that is equivalent to base but with the
+   given numpunct facet installed; as the construction of
+   a locale with a fresh facet is surprisingly expensive,
+   the most recently derived locale is cached per thread
+   and facet such that repeated invocations for the same
+   base locale are almost free */
+template<typename Facet>
+inline const std::locale& cached_locale(const std::locale& base) {
+   thread_local std::locale cached_base(base);
+   thread_local std::locale derived(base, new Facet());
+   if (!(cached_base == base)) {
+      cached_base = base;
+      derived = std::locale(base, new Facet());
+   }
+   return derived;
+}
+
+/* deliver the codecvt facet for the given locale; looking up a
+   facet via std::use_facet per converted value is surprisingly
+   expensive, hence the most recently used facet is cached per
+   thread in the same spirit as cached_locale above; the cached
+   locale copy keeps the facet alive */
+template<typename From, typename To>
+inline const std::codecvt<From, To, std::mbstate_t>&
+cached_codecvt(const std::locale& loc) {
+   thread_local std::locale cached_base(loc);
+   thread_local const std::codecvt<From, To, std::mbstate_t>* facet =
+      &std::use_facet<std::codecvt<From, To, std::mbstate_t>>(loc);
+   if (!(cached_base == loc)) {
+      cached_base = loc;
+      facet = &std::use_facet<std::codecvt<From, To, std::mbstate_t>>(loc);
+   }
+   return *facet;
+}
+
+/* RAII object that saves the formatting state which fmt::printf
+   possibly touches, i.e. the format flags, width, precision, and
+   the fill character, and makes sure that it is restored on
+   destruction; this is considerably cheaper than copyfmt which
+   would also copy the locale, the exception mask, the tied
+   stream, the registered callbacks, and the iword/pword arrays;
+   the locale is saved and restored upon request only */
 template<typename CharT, typename Traits>
 struct format_saver {
    format_saver(std::basic_ios<CharT, Traits>& s) :
-      s(s), format_keeper(nullptr) {
-      format_keeper.copyfmt(s);
+      s(s), flags(s.flags()), width(s.width()),
+      precision(s.precision()), fill(s.fill()),
+      locale_saved(false) {
    }
    ~format_saver() {
-      s.copyfmt(format_keeper);
+      if (locale_saved) s.imbue(locale);
+      s.flags(flags);
+      s.width(width);
+      s.precision(precision);
+      s.fill(fill);
+   }
+   /* remember the current locale and restore it on destruction;
+      to be invoked before the stream is imbued with another
+      locale, e.g. for grouping */
+   void save_locale() {
+      locale = s.getloc();
+      locale_saved = true;
    }
    std::basic_ios<CharT, Traits>& s;
-   std::basic_ios<CharT, Traits> format_keeper;
+   std::ios_base::fmtflags flags;
+   std::streamsize width;
+   std::streamsize precision;
+   CharT fill;
+   bool locale_saved;
+   std::locale locale;
 };
 
 /* reset the entire format state to its default */
@@ -407,7 +894,7 @@ struct format_segment {
 /* parse integer value from format string;
    return false in case of overflows */
 template<typename CharT, typename T>
-bool parse_integer(const CharT*& format, T& val) {
+FMT_PRINTF_CONSTEXPR bool parse_integer(const CharT*& format, T& val) {
    T v{};
    CharT ch = *format;
    constexpr T maxval = std::numeric_limits<T>::max();
@@ -424,11 +911,47 @@ bool parse_integer(const CharT*& format, T& val) {
    return true;
 }
 
+/* locate the next '%' or, failing that, the terminating null
+   byte; for char and wchar_t formats long verbatim stretches
+   are delegated to the optimized library scan routines */
+inline const char* find_percent_runtime(const char* format) {
+   const char* p = std::strchr(format, '%');
+   return p? p: format + std::strlen(format);
+}
+inline const wchar_t* find_percent_runtime(const wchar_t* format) {
+   const wchar_t* p = std::wcschr(format, L'%');
+   return p? p: format + std::wcslen(format);
+}
+template<typename CharT>
+inline const CharT* find_percent_runtime(const CharT* format) {
+   while (*format && *format != '%') ++format;
+   return format;
+}
+
+template<typename CharT>
+FMT_PRINTF_CONSTEXPR const CharT* find_percent(const CharT* format) {
+#if __cplusplus < 201402L
+   /* no constant evaluation to care about in C++11 */
+   return find_percent_runtime(format);
+#else
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+   /* the accelerated scan is off limits during constant evaluation */
+   if (!__builtin_is_constant_evaluated()) {
+      return find_percent_runtime(format);
+   }
+#endif
+#endif
+   while (*format && *format != '%') ++format;
+   return format;
+#endif
+}
+
 /* parse up to one format specification and
    invoke the respective manipulators for out
    and/or set the corresponding flags */
 template<typename CharT>
-inline format_segment<CharT>
+FMT_PRINTF_CONSTEXPR format_segment<CharT>
 parse_format_segment(const CharT* format, integer arg_index) {
    format_segment<CharT> result;
    if (!format) return result;
@@ -436,11 +959,9 @@ parse_format_segment(const CharT* format, integer arg_index) {
    /* skip everything until we encounter a placeholder
       or the end of the format string */
    result.beginp = format;
-   CharT ch = *format;
-   while (ch && ch != '%') {
-      ch = *++format;
-   }
+   format = find_percent(format);
    result.endp = format;
+   CharT ch = *format;
 
    /* end of format string reached? */
    if (!ch) {
@@ -462,7 +983,7 @@ parse_format_segment(const CharT* format, integer arg_index) {
    /* check if we have an argument index */
    if (ch >= '1' && ch <= '9') {
       const CharT* begin = format;
-      integer index;
+      integer index = 0;
       if (parse_integer(format, index) && *format == '$') {
 	 /* accept argument index */
 	 result.value_index = index - 1;
@@ -482,18 +1003,18 @@ parse_format_segment(const CharT* format, integer arg_index) {
 	    break;
 	 case '-':
 	    result.flags |= minus_flag;
-	    result.fmtflags |= std::ios_base::left;
+	    result.fmtflags = result.fmtflags | std::ios_base::left;
 	    break;
 	 case '0': result.flags |= zero_fill; break;
 	 case '+':
 	    result.flags |= plus_flag;
-	    result.fmtflags |= std::ios_base::showpos;
+	    result.fmtflags = result.fmtflags | std::ios_base::showpos;
 	    break;
 	 case ' ': result.flags |= space_flag; break;
 	 case '#':
 	    result.flags |= special_flag;
-	    result.fmtflags |= (std::ios_base::showbase |
-	       std::ios_base::showpoint);
+	    result.fmtflags = result.fmtflags |
+	       (std::ios_base::showbase | std::ios_base::showpoint);
 	    break;
       }
       ch = *++format;
@@ -513,7 +1034,7 @@ parse_format_segment(const CharT* format, integer arg_index) {
    if (ch == '*') {
       result.flags |= dyn_width; ch = *++format;
       if (ch >= '1' && ch <= '9') {
-	 integer index;
+	 integer index = 0;
 	 if (!parse_integer(format, index) || *format != '$') return result;
 	 ch = *++format;
 	 result.width_index = index - 1;
@@ -534,7 +1055,7 @@ parse_format_segment(const CharT* format, integer arg_index) {
       if (ch == '*') {
 	 result.flags |= dyn_precision; ch = *++format;
 	 if (ch >= '1' && ch <= '9') {
-	    integer index;
+	    integer index = 0;
 	    if (!parse_integer(format, index) || *format != '$') return result;
 	    ch = *++format;
 	    result.precision_index = index - 1;
@@ -579,25 +1100,26 @@ parse_format_segment(const CharT* format, integer arg_index) {
 	 result.base = 16;
 	 break;
       case 'X':
-	 result.fmtflags |= std::ios_base::uppercase;
+	 result.fmtflags = result.fmtflags | std::ios_base::uppercase;
 	 result.flags |= is_integer;
 	 result.base = 16;
 	 break;
       case 'f':
-	 result.fmtflags |= std::ios_base::fixed;
+	 result.fmtflags = result.fmtflags | std::ios_base::fixed;
 	 result.base = 10;
 	 break;
       case 'F':
-	 result.fmtflags |= (std::ios_base::fixed | std::ios_base::uppercase);
+	 result.fmtflags = result.fmtflags |
+	    (std::ios_base::fixed | std::ios_base::uppercase);
 	 result.flags |= toupper;
 	 result.base = 10;
 	 break;
       case 'e':
-	 result.fmtflags |= std::ios_base::scientific;
+	 result.fmtflags = result.fmtflags | std::ios_base::scientific;
 	 result.base = 10;
 	 break;
       case 'E':
-	 result.fmtflags |=
+	 result.fmtflags = result.fmtflags |
 	    std::ios_base::scientific | std::ios_base::uppercase;
 	 result.flags |= toupper;
 	 result.base = 10;
@@ -607,16 +1129,17 @@ parse_format_segment(const CharT* format, integer arg_index) {
 	 result.base = 10;
 	 break;
       case 'G':
-	 result.fmtflags |= std::ios_base::uppercase;
+	 result.fmtflags = result.fmtflags | std::ios_base::uppercase;
 	 result.flags |= toupper;
 	 result.base = 10;
 	 break;
       case 'a':
-	 result.fmtflags |= std::ios_base::scientific | std::ios_base::fixed;
+	 result.fmtflags = result.fmtflags |
+	    std::ios_base::scientific | std::ios_base::fixed;
 	 result.base = 16;
 	 break;
       case 'A':
-	 result.fmtflags |= std::ios_base::scientific |
+	 result.fmtflags = result.fmtflags | std::ios_base::scientific |
 	    std::ios_base::fixed | std::ios_base::uppercase;
 	 result.flags |= toupper;
 	 result.base = 16;
@@ -635,7 +1158,7 @@ parse_format_segment(const CharT* format, integer arg_index) {
       case 's':
 	 /* when boolean values are printed with %s, we get
 	    more readable results; idea taken from N3506 */
-	 result.fmtflags |= std::ios_base::boolalpha;
+	 result.fmtflags = result.fmtflags | std::ios_base::boolalpha;
 	 break;
       case 'n':
 	 /* nothing to be done here */
@@ -660,6 +1183,79 @@ parse_format_segment(const CharT* format, integer arg_index) {
    return result;
 }
 
+/* argument requirements which can be derived from a format string,
+   used for the compile-time checks below */
+enum class arg_kind : unsigned char {
+   unused, any, integral_value, int_pointer
+};
+
+/* record the requirement for the argument with the given index;
+   false is returned if the index is out of range or in conflict
+   with an earlier requirement for the same argument */
+FMT_PRINTF_CONSTEXPR bool require_arg(arg_kind* required,
+      integer nof_values, integer index, arg_kind kind) {
+   if (index < 0 || index >= nof_values) return false;
+   if (kind == arg_kind::any) {
+      if (required[index] == arg_kind::unused) {
+	 required[index] = kind;
+      }
+      return true;
+   }
+   if (required[index] == arg_kind::unused ||
+	 required[index] == arg_kind::any) {
+      required[index] = kind;
+      return true;
+   }
+   return required[index] == kind;
+}
+
+/* check whether a format string can be processed with arguments
+   of the types Values...; this mirrors the conditions under which
+   fmt::printf returns -1 at runtime, i.e. the format must parse,
+   enough arguments must be given, arguments for dynamic widths
+   and precisions must be of integral type, and %n requires an
+   int pointer; with C++14 and beyond this can be evaluated at
+   compile time for string literals */
+template<typename... Values, typename CharT>
+FMT_PRINTF_CONSTEXPR bool format_compatible(const CharT* format) {
+   constexpr integer nof_values = sizeof...(Values);
+   constexpr bool is_integral_value[nof_values + 1] = {
+      std::is_integral<
+	 typename std::remove_reference<Values>::type>::value..., false};
+   constexpr bool is_int_pointer[nof_values + 1] = {
+      std::is_same<typename std::decay<Values>::type, int*>::value..., false};
+   arg_kind required[nof_values + 1] = {};
+   integer nof_args = 0;
+   while (format) {
+      auto fseg = parse_format_segment(format, nof_args);
+      if (!fseg.valid) return false;
+      nof_args += fseg.nof_args;
+      if (fseg.width_index >= 0 && !require_arg(required, nof_values,
+	    fseg.width_index, arg_kind::integral_value)) {
+	 return false;
+      }
+      if (fseg.precision_index >= 0 && !require_arg(required, nof_values,
+	    fseg.precision_index, arg_kind::integral_value)) {
+	 return false;
+      }
+      if (fseg.value_index >= 0 && !require_arg(required, nof_values,
+	    fseg.value_index, fseg.conversion == 'n'?
+	       arg_kind::int_pointer: arg_kind::any)) {
+	 return false;
+      }
+      format = fseg.nextp;
+   }
+   for (integer i = 0; i < nof_values; ++i) {
+      if (required[i] == arg_kind::integral_value && !is_integral_value[i]) {
+	 return false;
+      }
+      if (required[i] == arg_kind::int_pointer && !is_int_pointer[i]) {
+	 return false;
+      }
+   }
+   return true;
+}
+
 /* similar to std::integer_sequence of C++14 */
 template<integer... Is> struct seq {
    typedef seq<Is..., sizeof...(Is)> next;
@@ -691,10 +1287,54 @@ inline auto apply(const Tuple& tuple, integer index, Function&& f, seq<Is...>)
    return apply_functions[index](tuple, std::forward<Function>(f));
 }
 
+/* tuples up to this size are dispatched through an unrolled
+   switch instead of the function pointer table such that the
+   individual instantiations can be inlined */
+constexpr integer max_switch_arity = 8;
+
+/* variant of the compile-time apply above which tolerates
+   instantiations beyond the actual tuple size as generated by
+   the unrolled switch below; these cases are never reached at
+   runtime as the callers check the index against the tuple size */
+template<integer N, typename Tuple, typename Function>
+inline auto apply_checked(const Tuple& tuple, Function&& f)
+      -> typename std::enable_if<
+	 (N < static_cast<integer>(std::tuple_size<Tuple>::value)),
+	 decltype(f(std::get<0>(tuple)))>::type {
+   return f(std::get<N>(tuple));
+}
+template<integer N, typename Tuple, typename Function>
+inline auto apply_checked(const Tuple& tuple, Function&& f)
+      -> typename std::enable_if<
+	 (N >= static_cast<integer>(std::tuple_size<Tuple>::value)),
+	 decltype(f(std::get<0>(tuple)))>::type {
+   return f(std::get<0>(tuple));
+}
+
 /* apply f on the n-th element of a tuple for runtime n */
 template<typename Tuple, typename Function>
 inline auto apply(const Tuple& tuple, integer index, Function&& f)
-      -> decltype(f(std::get<0>(tuple))) {
+      -> typename std::enable_if<
+	 (static_cast<integer>(std::tuple_size<Tuple>::value) <=
+	    max_switch_arity),
+	 decltype(f(std::get<0>(tuple)))>::type {
+   switch (index) {
+      case 1: return apply_checked<1>(tuple, std::forward<Function>(f));
+      case 2: return apply_checked<2>(tuple, std::forward<Function>(f));
+      case 3: return apply_checked<3>(tuple, std::forward<Function>(f));
+      case 4: return apply_checked<4>(tuple, std::forward<Function>(f));
+      case 5: return apply_checked<5>(tuple, std::forward<Function>(f));
+      case 6: return apply_checked<6>(tuple, std::forward<Function>(f));
+      case 7: return apply_checked<7>(tuple, std::forward<Function>(f));
+      default: return apply_checked<0>(tuple, std::forward<Function>(f));
+   }
+}
+template<typename Tuple, typename Function>
+inline auto apply(const Tuple& tuple, integer index, Function&& f)
+      -> typename std::enable_if<
+	 (static_cast<integer>(std::tuple_size<Tuple>::value) >
+	    max_switch_arity),
+	 decltype(f(std::get<0>(tuple)))>::type {
    return apply(tuple, index, std::forward<Function>(f),
       typename gen_seq<std::tuple_size<Tuple>::value>::type());
 }
@@ -761,42 +1401,14 @@ inline typename std::enable_if<
       !std::is_floating_point<
 	 typename std::remove_reference<Value>::type>::value &&
       !std::is_pointer<
-	 typename std::remove_reference<Value>::type>::value, bool>::type
+	 typename std::remove_reference<Value>::type>::value &&
+      !is_string<typename std::decay<Value>::type>::value, bool>::type
 print_value(std::basic_ostream<CharT, Traits>& out,
       const format_segment<CharT>&, Value&& value) {
    out << value;
    return !!out;
 }
 
-/* formatted output of floating point values */
-template<typename CharT, typename Traits, typename Value>
-inline typename std::enable_if<
-      std::is_floating_point<
-	 typename std::remove_reference<Value>::type>::value,
-      bool>::type
-print_value(std::basic_ostream<CharT, Traits>& out,
-      const format_segment<CharT>& fseg, Value&& value) {
-   if ((fseg.flags & zero_fill) && std::isfinite(value)) {
-      out << std::setfill(static_cast<CharT>('0'));
-      out.setf(std::ios_base::internal);
-   }
-   if ((fseg.flags & space_flag) && !std::signbit(value)) {
-      if (!out.put(' ')) return false;
-      if (fseg.width > 0) {
-	 out.width(fseg.width-1);
-      }
-   }
-   if (fseg.flags & toupper) {
-      /* the default output operators fail to
-	 use uppercase characters in some cases */
-      impl::uppercase_ostream<CharT, Traits> fpout(out);
-      fpout << value;
-   } else {
-      out << value;
-   }
-   return !!out;
-}
-
 template<typename Value>
 inline integer count_digits(Value value, integer base) {
    if (value == 0) {
@@ -810,26 +1422,296 @@ inline integer count_digits(Value value, integer base) {
    }
 }
 
-/* formatted output of character values (in case of %c)
-   where we got a non-char-type numerical value */
-template<typename CharT, typename Traits, typename Value>
-inline typename std::enable_if<!is_char<Value>::value, bool>::type
-print_char_value(std::basic_ostream<CharT, Traits>& out,
-      const format_segment<CharT>&, Value value) {
-   out << static_cast<CharT>(value);
-   return !!out;
-}
-
-/* formatted output of character values (in case of %c)
-   without conversion */
+/* pairs of decimal digits for the fast integer conversion path */
+constexpr char digit_pairs[] =
+   "0001020304050607080910111213141516171819"
+   "2021222324252627282930313233343536373839"
+   "4041424344454647484950515253545556575859"
+   "6061626364656667686970717273747576777879"
+   "8081828384858687888990919293949596979899";
+
+/* emit count copies of the given fill character in bounded chunks
+   such that long padding does not degenerate into one virtual
+   call per character */
 template<typename CharT, typename Traits>
-inline bool print_char_value(std::basic_ostream<CharT, Traits>& out,
-      const format_segment<CharT>&, CharT value) {
-   out << value;
-   return !!out;
+inline bool emit_fill(std::basic_ostream<CharT, Traits>& out,
+      CharT fill, integer count) {
+   constexpr integer chunk_size = 64;
+   CharT buf[chunk_size];
+   integer chunk = count < chunk_size? count: chunk_size;
+   for (integer i = 0; i < chunk; ++i) {
+      buf[i] = fill;
+   }
+   while (count > 0) {
+      chunk = count < chunk_size? count: chunk_size;
+      if (!out.write(buf, chunk)) return false;
+      count -= chunk;
+   }
+   return true;
 }
 
-/* formatted output of character values (in case of %c)
+/* direct formatting of integral values which bypasses std::num_put
+   and its per-value locale lookups and virtual calls; this is
+   used for all integer conversions without the grouping flag
+   where the output is locale-independent anyway as fmt::printf
+   suppresses grouping to conform to std::printf behaviour */
+template<typename CharT, typename Traits, typename Value>
+inline bool format_integer(std::basic_ostream<CharT, Traits>& out,
+      const format_segment<CharT>& fseg, Value value) {
+   using UValue = typename std::make_unsigned<Value>::type;
+   bool negative = false;
+   UValue mag = static_cast<UValue>(value);
+   if (fseg.base == 10 && is_negative(value)) {
+      /* octal and hexadecimal conversions print the unsigned
+	 representation, just decimal conversions carry a sign */
+      negative = true;
+      mag = UValue(0) - mag;
+   }
+   bool upper = (fseg.fmtflags & std::ios_base::uppercase) != 0;
+   /* generate the digits in reverse order */
+   char digits[sizeof(UValue) * CHAR_BIT / 3 + 2];
+   char* dend = digits + sizeof digits;
+   char* dp = dend;
+   switch (fseg.base) {
+      case 8:
+	 do {
+	    *--dp = '0' + static_cast<char>(mag & 7); mag >>= 3;
+	 } while (mag);
+	 break;
+      case 16: {
+	 const char* xdigits = upper?
+	    "0123456789ABCDEF": "0123456789abcdef";
+	 do {
+	    *--dp = xdigits[mag & 15]; mag >>= 4;
+	 } while (mag);
+	 break;
+      }
+      default:
+	 while (mag >= 100) {
+	    unsigned int rem = static_cast<unsigned int>(mag % 100);
+	    mag /= 100;
+	    *--dp = digit_pairs[rem * 2 + 1];
+	    *--dp = digit_pairs[rem * 2];
+	 }
+	 if (mag >= 10) {
+	    unsigned int rem = static_cast<unsigned int>(mag);
+	    *--dp = digit_pairs[rem * 2 + 1];
+	    *--dp = digit_pairs[rem * 2];
+	 } else {
+	    *--dp = '0' + static_cast<char>(mag);
+	 }
+	 break;
+   }
+   integer ndigits = dend - dp;
+   /* honour the precision, i.e. the minimal number of digits */
+   integer zdigits = ndigits;
+   if ((fseg.flags & precision) && fseg.precision > zdigits) {
+      zdigits = fseg.precision;
+   }
+   /* the '#' flag forces a leading zero for octal values */
+   if ((fseg.flags & special_flag) && fseg.base == 8 &&
+	 zdigits == ndigits && *dp != '0') {
+      ++zdigits;
+   }
+   /* the '#' flag prefixes non-zero hexadecimal values with 0x */
+   const char* prefix = "";
+   integer prefix_len = 0;
+   if ((fseg.flags & special_flag) && fseg.base == 16 && value != 0) {
+      prefix = upper? "0X": "0x"; prefix_len = 2;
+   }
+   /* determine the sign character, if any */
+   char sign = 0;
+   if (negative) {
+      sign = '-';
+   } else if ((fseg.flags & plus_flag) && fseg.base == 10 &&
+	 std::is_signed<Value>::value) {
+      sign = '+';
+   } else if ((fseg.flags & space_flag) && !is_negative(value)) {
+      sign = ' ';
+   }
+   integer total = zdigits + prefix_len + (sign? 1: 0);
+   integer width = fseg.width > 0? fseg.width: 0;
+   integer lead_zeros = zdigits - ndigits;
+   if ((fseg.flags & zero_fill) && width > total) {
+      lead_zeros += width - total;
+      total = width;
+   }
+   bool left = (fseg.flags & minus_flag) != 0;
+   if (!left && width > total) {
+      if (!emit_fill(out, out.widen(' '), width - total)) return false;
+   }
+   CharT head[4];
+   integer head_len = 0;
+   if (sign) head[head_len++] = static_cast<CharT>(sign);
+   for (integer i = 0; i < prefix_len; ++i) {
+      head[head_len++] = static_cast<CharT>(prefix[i]);
+   }
+   if (head_len > 0 && !out.write(head, head_len)) return false;
+   if (lead_zeros > 0 &&
+	 !emit_fill(out, static_cast<CharT>('0'), lead_zeros)) {
+      return false;
+   }
+   CharT buf[sizeof digits];
+   for (integer i = 0; i < ndigits; ++i) {
+      buf[i] = static_cast<CharT>(dp[i]);
+   }
+   if (ndigits > 0 && !out.write(buf, ndigits)) return false;
+   if (left && width > total) {
+      if (!emit_fill(out, out.widen(' '), width - total)) return false;
+   }
+   return !!out;
+}
+
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+/* direct formatting of finite floating point values through
+   std::to_chars which bypasses std::num_put and the per-character
+   uppercase_ostream detour; this is used for the %f, %e, and %g
+   conversion families on streams with the classic locale where
+   the output is locale-independent anyway */
+template<typename CharT, typename Traits, typename Value>
+inline bool format_float(std::basic_ostream<CharT, Traits>& out,
+      const format_segment<CharT>& fseg, Value value) {
+   std::chars_format cfmt = std::chars_format::general;
+   if (fseg.conversion == 'f' || fseg.conversion == 'F') {
+      cfmt = std::chars_format::fixed;
+   } else if (fseg.conversion == 'e' || fseg.conversion == 'E') {
+      cfmt = std::chars_format::scientific;
+   }
+   int prec = 6;
+   if ((fseg.flags & precision) && fseg.precision >= 0) {
+      prec = static_cast<int>(fseg.precision);
+   }
+   char digits[512];
+   char* dbegin = digits;
+   auto result = std::to_chars(dbegin, dbegin + sizeof digits,
+      value, cfmt, prec);
+   if (result.ec == std::errc::value_too_large) {
+      /* huge precisions and %f conversions of huge values do not
+	 fit onto the stack; max_exponent10 bounds the number of
+	 integral digits, the slack covers sign, decimal point,
+	 and exponent */
+      std::size_t spill_size = static_cast<std::size_t>(prec) +
+	 std::numeric_limits<Value>::max_exponent10 + 16;
+      scratch_buffer<char> spill(spill_size);
+      dbegin = spill.data();
+      result = std::to_chars(dbegin, dbegin + spill_size,
+	 value, cfmt, prec);
+   }
+   if (result.ec != std::errc()) return false;
+   if (fseg.flags & impl::toupper) {
+      /* just 'e' can show up in finite decimal output */
+      for (char* p = dbegin; p != result.ptr; ++p) {
+	 if (*p == 'e') *p = 'E';
+      }
+   }
+   const char* dp = dbegin;
+   integer ndigits = result.ptr - dbegin;
+   char sign = 0;
+   if (*dp == '-') {
+      sign = '-'; ++dp; --ndigits;
+   } else if (fseg.flags & plus_flag) {
+      sign = '+';
+   } else if (fseg.flags & space_flag) {
+      sign = ' ';
+   }
+   integer total = ndigits + (sign? 1: 0);
+   integer width = fseg.width > 0? fseg.width: 0;
+   integer lead_zeros = 0;
+   if ((fseg.flags & zero_fill) && width > total) {
+      lead_zeros = width - total;
+      total = width;
+   }
+   bool left = (fseg.flags & minus_flag) != 0;
+   if (!left && width > total) {
+      if (!emit_fill(out, out.widen(' '), width - total)) return false;
+   }
+   if (sign) {
+      CharT sc = static_cast<CharT>(sign);
+      if (!out.write(&sc, 1)) return false;
+   }
+   if (lead_zeros > 0 &&
+	 !emit_fill(out, static_cast<CharT>('0'), lead_zeros)) {
+      return false;
+   }
+   constexpr integer chunk_size = 64;
+   CharT buf[chunk_size];
+   while (ndigits > 0) {
+      integer chunk = ndigits < chunk_size? ndigits: chunk_size;
+      for (integer i = 0; i < chunk; ++i) {
+	 buf[i] = static_cast<CharT>(dp[i]);
+      }
+      if (!out.write(buf, chunk)) return false;
+      dp += chunk; ndigits -= chunk;
+   }
+   if (left && width > total) {
+      if (!emit_fill(out, out.widen(' '), width - total)) return false;
+   }
+   return !!out;
+}
+#endif
+
+/* formatted output of floating point values */
+template<typename CharT, typename Traits, typename Value>
+inline typename std::enable_if<
+      std::is_floating_point<
+	 typename std::remove_reference<Value>::type>::value,
+      bool>::type
+print_value(std::basic_ostream<CharT, Traits>& out,
+      const format_segment<CharT>& fseg, Value&& value) {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+   switch (fseg.conversion) {
+      case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+	 if (std::isfinite(value) &&
+	       !(fseg.flags & (grouping_flag | special_flag)) &&
+	       out.getloc() == std::locale::classic()) {
+	    return format_float(out, fseg, value);
+	 }
+	 break;
+      default:
+	 break;
+   }
+#endif
+   if ((fseg.flags & zero_fill) && std::isfinite(value)) {
+      out << std::setfill(static_cast<CharT>('0'));
+      out.setf(std::ios_base::internal);
+   }
+   if ((fseg.flags & space_flag) && !std::signbit(value)) {
+      if (!out.put(' ')) return false;
+      if (fseg.width > 0) {
+	 out.width(fseg.width-1);
+      }
+   }
+   if (fseg.flags & toupper) {
+      /* the default output operators fail to
+	 use uppercase characters in some cases */
+      impl::uppercase_ostream<CharT, Traits> fpout(out);
+      fpout << value;
+   } else {
+      out << value;
+   }
+   return !!out;
+}
+
+/* formatted output of character values (in case of %c)
+   where we got a non-char-type numerical value */
+template<typename CharT, typename Traits, typename Value>
+inline typename std::enable_if<!is_char<Value>::value, bool>::type
+print_char_value(std::basic_ostream<CharT, Traits>& out,
+      const format_segment<CharT>&, Value value) {
+   out << static_cast<CharT>(value);
+   return !!out;
+}
+
+/* formatted output of character values (in case of %c)
+   without conversion */
+template<typename CharT, typename Traits>
+inline bool print_char_value(std::basic_ostream<CharT, Traits>& out,
+      const format_segment<CharT>&, CharT value) {
+   out << value;
+   return !!out;
+}
+
+/* formatted output of character values (in case of %c)
    that needs to be widened */
 template<typename CharT, typename Traits>
 inline typename std::enable_if<!std::is_same<char, CharT>::value,
@@ -840,6 +1722,72 @@ print_char_value(std::basic_ostream<CharT, Traits>& out,
    return !!out;
 }
 
+/* convert a character sequence through the codecvt facet of the
+   stream's locale and emit it honouring width and justification;
+   the conversion runs through a stack buffer with chunked bulk
+   writes and allocates only for pathological lengths combined
+   with a field width */
+template<typename CharT, typename Traits, typename Value>
+inline bool convert_and_emit(std::basic_ostream<CharT, Traits>& out,
+      const format_segment<CharT>& fseg, const Value* value, integer len) {
+   auto& f = cached_codecvt<Value, CharT>(out.getloc());
+   std::mbstate_t state{};
+   constexpr integer buf_size = 256;
+   CharT buf[buf_size];
+   integer width = fseg.width > 0? fseg.width: 0;
+   if (width == 0) {
+      /* without a field width the converted text can be
+	 streamed out chunk by chunk */
+      const Value* from = value;
+      const Value* from_end = value + len;
+      while (from != from_end) {
+	 const Value* from_next = nullptr;
+	 CharT* to_next = nullptr;
+	 auto result = f.out(state, from, from_end, from_next,
+	    buf, buf + buf_size, to_next);
+	 if (result == std::codecvt_base::error ||
+	       result == std::codecvt_base::noconv ||
+	       from_next == from) {
+	    out.setstate(std::ios_base::failbit);
+	    return false;
+	 }
+	 if (to_next > buf && !out.write(buf, to_next - buf)) return false;
+	 from = from_next;
+      }
+      return !!out;
+   }
+   /* with a field width the converted length must be known
+      before anything is emitted */
+   const Value* from_next = nullptr;
+   CharT* to_begin = buf;
+   CharT* to_next = nullptr;
+   auto result = f.out(state, value, value + len, from_next,
+      to_begin, to_begin + buf_size, to_next);
+   if (result != std::codecvt_base::ok) {
+      std::size_t spill_size =
+	 static_cast<std::size_t>(len) * f.max_length();
+      scratch_buffer<CharT> spill(spill_size);
+      state = std::mbstate_t{};
+      to_begin = spill.data();
+      result = f.out(state, value, value + len, from_next,
+	 to_begin, to_begin + spill_size, to_next);
+   }
+   if (result != std::codecvt_base::ok) {
+      out.setstate(std::ios_base::failbit);
+      return false;
+   }
+   integer clen = to_next - to_begin;
+   bool left = (fseg.flags & minus_flag) != 0;
+   if (!left && width > clen) {
+      if (!emit_fill(out, out.fill(), width - clen)) return false;
+   }
+   if (clen > 0 && !out.write(to_begin, clen)) return false;
+   if (left && width > clen) {
+      if (!emit_fill(out, out.fill(), width - clen)) return false;
+   }
+   return !!out;
+}
+
 /* formatted output of character values (in case of %c)
    that need to be converted */
 template<typename CharT, typename Traits, typename Value>
@@ -849,23 +1797,8 @@ inline typename std::enable_if<
       !std::is_same<Value, CharT>::value,
       bool>::type
 print_char_value(std::basic_ostream<CharT, Traits>& out,
-      const format_segment<CharT>&, Value value) {
-   auto& f = std::use_facet<std::codecvt<Value, CharT, std::mbstate_t>>(
-      out.getloc());
-   std::mbstate_t state{};
-   std::basic_string<CharT> converted(f.max_length(), 0);
-   const Value* from_next;
-   CharT* to_next;
-   auto result = f.out(state,
-      /* from */ &value, &value + 1, from_next,
-      /* to */ &converted[0], &converted[converted.size()], to_next);
-   if (result == std::codecvt_base::ok) {
-      converted.resize(to_next - &converted[0]);
-      out << converted;
-   } else {
-      out.setstate(std::ios_base::failbit);
-   }
-   return !!out;
+      const format_segment<CharT>& fseg, Value value) {
+   return convert_and_emit(out, fseg, &value, integer(1));
 }
 
 /* formatted output of integral values
@@ -881,6 +1814,12 @@ print_value(std::basic_ostream<CharT, Traits>& out,
    if (fseg.flags & is_charval) {
       print_char_value(out, fseg, value);
    } else if (fseg.flags & is_integer) {
+      if (!(fseg.flags & grouping_flag)) {
+	 /* locale-independent fast path;
+	    convert character types to a corresponding integer type */
+	 using integer_type = decltype(value + 0);
+	 return format_integer(out, fseg, static_cast<integer_type>(value));
+      }
       if (fseg.flags & zero_fill) {
 	 out << std::internal << std::setfill(out.widen('0'));
       } else if (fseg.flags & precision) {
@@ -903,9 +1842,9 @@ print_value(std::basic_ostream<CharT, Traits>& out,
 		  /* padding has to be postponed */
 		  padding = fseg.width - fseg.precision - extra;
 	       } else {
-		  for (int i = 0; i < fseg.width - fseg.precision - extra;
-			++i) {
-		     out.put(out.widen(' '));
+		  if (!emit_fill(out, out.widen(' '),
+			fseg.width - fseg.precision - extra)) {
+		     return false;
 		  }
 	       }
 	    }
@@ -924,8 +1863,8 @@ print_value(std::basic_ostream<CharT, Traits>& out,
       using integer = decltype(value + 0);
       if (!(out << static_cast<integer>(value))) return false;
       /* print padding now when it is left adjusted */
-      for (int i = 0; i < padding; ++i) {
-	 out.put(out.widen(' '));
+      if (padding > 0 && !emit_fill(out, out.widen(' '), padding)) {
+	 return false;
       }
    } else {
       /* neither %c, %d, %o, %x etc. has been given as expected,
@@ -971,18 +1910,16 @@ inline bool print_value(std::basic_ostream<CharT, Traits>& out,
 	 }
 	 bool left = (out.flags() & std::ios_base::adjustfield) ==
 		  std::ios_base::left;
-	 if (!left) {
-	    for (integer i = 0; i < padding; ++i) {
-	       out.put(out.widen(' '));
-	    }
+	 if (!left && padding > 0 &&
+	       !emit_fill(out, out.widen(' '), padding)) {
+	    return false;
 	 }
 	 if (precision > 0) {
 	    out.write(value, precision);
 	 }
-	 if (left) {
-	    for (integer i = 0; i < padding; ++i) {
-	       out.put(out.widen(' '));
-	    }
+	 if (left && padding > 0 &&
+	       !emit_fill(out, out.widen(' '), padding)) {
+	    return false;
 	 }
       } else {
 	 out << value;
@@ -1047,18 +1984,25 @@ print_value(std::basic_ostream<CharT, Traits>& out,
       if (fseg.width > len) {
 	 padding = fseg.width - len;
       }
-      if (!left) {
-	 for (integer i = 0; i < padding; ++i) {
-	    out.put(out.widen(' '));
-	 }
-      }
-      for (integer i = 0; i < len; ++i) {
-	 out.put(out.widen(value[i]));
+      if (!left && padding > 0 &&
+	    !emit_fill(out, out.widen(' '), padding)) {
+	 return false;
       }
-      if (left) {
-	 for (integer i = 0; i < padding; ++i) {
-	    out.put(out.widen(' '));
+      /* widen through the cached table and emit in bounded chunks */
+      const CharT* table = widening_table<CharT>(out.getloc());
+      constexpr integer chunk_size = 64;
+      CharT buf[chunk_size];
+      while (len > 0) {
+	 integer chunk = len < chunk_size? len: chunk_size;
+	 for (integer i = 0; i < chunk; ++i) {
+	    buf[i] = table[static_cast<unsigned char>(value[i])];
 	 }
+	 if (!out.write(buf, chunk)) return false;
+	 value += chunk; len -= chunk;
+      }
+      if (left && padding > 0 &&
+	    !emit_fill(out, out.widen(' '), padding)) {
+	 return false;
       }
    }
    return !!out;
@@ -1093,25 +2037,111 @@ print_value(std::basic_ostream<CharT, Traits>& out,
       } else {
 	 while (value[len]) ++len;
       }
-      auto& f = std::use_facet<std::codecvt<Value, CharT, std::mbstate_t>>(
-	 out.getloc());
-      std::mbstate_t state{};
-      std::basic_string<CharT> converted(len * f.max_length(), 0);
-      const Value* from_next;
-      CharT* to_next;
-      auto result = f.out(state,
-	 /* from */ value, value + len, from_next,
-	 /* to */ &converted[0], &converted[converted.size()], to_next);
-      if (result == std::codecvt_base::ok) {
-	 converted.resize(to_next - &converted[0]);
-	 out << converted;
-      } else {
-	 out.setstate(std::ios_base::failbit);
+      return convert_and_emit(out, fseg, value, len);
+   }
+   return !!out;
+}
+
+/* emit a string of already known length honouring precision,
+   width, and justification; the known length turns precision
+   truncation and padding into plain arithmetic and the payload
+   into one bulk write */
+template<typename CharT, typename Traits>
+inline bool print_string_value(std::basic_ostream<CharT, Traits>& out,
+      const format_segment<CharT>& fseg, const CharT* value, integer len) {
+   if ((fseg.flags & precision) &&
+	 fseg.precision >= 0 && fseg.precision < len) {
+      len = fseg.precision;
+   }
+   integer padding = 0;
+   if (fseg.width > len) {
+      padding = fseg.width - len;
+   }
+   bool left = (fseg.flags & minus_flag) != 0;
+   if (!left && padding > 0) {
+      if (!emit_fill(out, out.widen(' '), padding)) return false;
+   }
+   if (len > 0 && !out.write(value, len)) return false;
+   if (left && padding > 0) {
+      if (!emit_fill(out, out.widen(' '), padding)) return false;
+   }
+   return !!out;
+}
+
+/* variant for strings that need to be widened */
+template<typename CharT, typename Traits>
+inline typename std::enable_if<!std::is_same<CharT, char>::value, bool>::type
+print_string_value(std::basic_ostream<CharT, Traits>& out,
+      const format_segment<CharT>& fseg, const char* value, integer len) {
+   if ((fseg.flags & precision) &&
+	 fseg.precision >= 0 && fseg.precision < len) {
+      len = fseg.precision;
+   }
+   integer padding = 0;
+   if (fseg.width > len) {
+      padding = fseg.width - len;
+   }
+   bool left = (fseg.flags & minus_flag) != 0;
+   if (!left && padding > 0) {
+      if (!emit_fill(out, out.widen(' '), padding)) return false;
+   }
+   const CharT* table = widening_table<CharT>(out.getloc());
+   constexpr integer chunk_size = 64;
+   CharT buf[chunk_size];
+   while (len > 0) {
+      integer chunk = len < chunk_size? len: chunk_size;
+      for (integer i = 0; i < chunk; ++i) {
+	 buf[i] = table[static_cast<unsigned char>(value[i])];
       }
+      if (!out.write(buf, chunk)) return false;
+      value += chunk; len -= chunk;
+   }
+   if (left && padding > 0) {
+      if (!emit_fill(out, out.widen(' '), padding)) return false;
    }
    return !!out;
 }
 
+/* variant for strings that need to be converted */
+template<typename CharT, typename Traits, typename Value>
+inline typename std::enable_if<
+      !std::is_same<CharT, Value>::value &&
+      !std::is_same<char, Value>::value, bool>::type
+print_string_value(std::basic_ostream<CharT, Traits>& out,
+      const format_segment<CharT>& fseg, const Value* value, integer len) {
+   if ((fseg.flags & precision) &&
+	 fseg.precision >= 0 && fseg.precision < len) {
+      len = fseg.precision;
+   }
+   return convert_and_emit(out, fseg, value, len);
+}
+
+/* formatted output of std::basic_string values; in contrast to
+   the pointer overloads above the size is already known which
+   spares the scan for the terminating null byte */
+template<typename CharT, typename Traits,
+   typename Value, typename STraits, typename SAlloc>
+inline typename std::enable_if<is_char<Value>::value, bool>::type
+print_value(std::basic_ostream<CharT, Traits>& out,
+      const format_segment<CharT>& fseg,
+      const std::basic_string<Value, STraits, SAlloc>& value) {
+   return print_string_value(out, fseg, value.data(),
+      static_cast<integer>(value.size()));
+}
+
+#if __cplusplus >= 201703L
+/* likewise for std::basic_string_view values */
+template<typename CharT, typename Traits,
+   typename Value, typename STraits>
+inline typename std::enable_if<is_char<Value>::value, bool>::type
+print_value(std::basic_ostream<CharT, Traits>& out,
+      const format_segment<CharT>& fseg,
+      std::basic_string_view<Value, STraits> value) {
+   return print_string_value(out, fseg, value.data(),
+      static_cast<integer>(value.size()));
+}
+#endif
+
 /* formatted output of non-char pointers that
    have possibly a %p conversion */
 template<typename CharT, typename Traits, typename Value>
@@ -1142,6 +2172,40 @@ print_value(std::basic_ostream<CharT, Traits>& out,
    return print_value(out, fseg, static_cast<const Value*>(value));
 }
 
+/* apply the stream-state settings of one conversion, emit the
+   given value, and restore the previous stream state; this is
+   shared between the runtime tuple dispatch below and the
+   compile-time dispatch of constexpr_format */
+template<typename CharT, typename Traits, typename Value>
+inline bool emit_conversion(std::basic_ostream<CharT, Traits>& out,
+      const format_segment<CharT>& fseg, Value&& value) {
+   format_saver<CharT, Traits> fsaver(out);
+   out.setf(fseg.fmtflags);
+   out.setf(fseg.base == 8? std::ios_base::oct  :
+	    fseg.base == 10? std::ios_base::dec :
+	    fseg.base == 16? std::ios_base::hex :
+	    std::ios_base::fmtflags(0), std::ios_base::basefield);
+   if (fseg.width > 0) {
+      out.width(fseg.width);
+   }
+   if ((fseg.flags & precision) && fseg.precision >= 0) {
+      out.precision(fseg.precision);
+   }
+   if (fseg.flags & grouping_flag) {
+      fsaver.save_locale();
+      out.imbue(cached_locale<thousands_grouping>(out.getloc()));
+   } else if (fseg.conversion != 'c' && fseg.conversion != 'C' &&
+	 out.getloc() != std::locale::classic()) {
+      /* suppress the grouping of the stream's locale to conform
+	 to std::printf behaviour; this is decided per segment
+	 such that formats without affected conversions do not
+	 touch the locale at all */
+      fsaver.save_locale();
+      out.imbue(cached_locale<suppress_grouping>(out.getloc()));
+   }
+   return print_value(out, fseg, std::forward<Value>(value));
+}
+
 template<typename CharT, typename Traits>
 struct process_value_f {
    process_value_f(std::basic_ostream<CharT, Traits>& out,
@@ -1150,7 +2214,7 @@ struct process_value_f {
    }
    template<typename Value>
    bool operator()(Value&& value) {
-      return print_value(out, fseg, std::forward<Value>(value));
+      return emit_conversion(out, fseg, std::forward<Value>(value));
    }
    std::basic_ostream<CharT, Traits>& out;
    const format_segment<CharT>& fseg;
@@ -1181,8 +2245,216 @@ inline bool set_value(Value, std::streamsize) {
    return false;
 }
 
+/* emit one parsed format segment to the counting output stream,
+   i.e. the stretch to be printed in verbatim and, if present,
+   the associated conversion; false is returned in case of failures */
+template<typename CharT, typename Traits, typename Tuple>
+inline bool process_segment(counting_ostream<CharT, Traits>& cout,
+      const Tuple& tuple, format_segment<CharT> fseg) {
+   FMT_PRINTF_COUNT(segments_processed, 1);
+#if defined(FMT_PRINTF_STATS)
+   if (fseg.value_index >= 0) {
+      if (fseg.flags & is_charval) {
+	 stats_counters().char_conversions += 1;
+      } else if (fseg.flags & (is_integer | is_unsigned | is_pointer)) {
+	 stats_counters().integer_conversions += 1;
+      } else {
+	 switch (fseg.conversion) {
+	    case 'a': case 'A': case 'e': case 'E':
+	    case 'f': case 'F': case 'g': case 'G':
+	       stats_counters().float_conversions += 1; break;
+	    case 's': case 'S':
+	       stats_counters().string_conversions += 1; break;
+	    default:
+	       stats_counters().other_conversions += 1; break;
+	 }
+      }
+   }
+#endif
+   if (fseg.endp > fseg.beginp) {
+      cout.write(fseg.beginp, fseg.endp - fseg.beginp);
+      if (!cout) return false;
+   }
+   if (fseg.value_index >= 0) {
+      if (fseg.conversion == 'n') {
+	 if (set_value(tuple, fseg.value_index, cout.get_count()) < 0) {
+	    return false;
+	 }
+      } else {
+	 if (fseg.width_index >= 0) {
+	    fseg.width = get_value(tuple, fseg.width_index);
+	 }
+	 if (fseg.precision_index >= 0) {
+	    fseg.precision = get_value(tuple, fseg.precision_index);
+	 }
+	 if (!process_value(tuple, fseg.value_index, cout, fseg)) {
+	    return false;
+	 }
+      }
+   }
+   return true;
+}
+
+/* background writer shared by all fmt::printf_async invocations
+   for streams of the given character type; formatted output is
+   placed on a bounded queue and one dedicated thread performs
+   the actual streambuf writes in batches; the formatting buffers
+   are pooled and recycled to avoid one allocation per call */
+template<typename CharT, typename Traits = std::char_traits<CharT>>
+class async_writer {
+   public:
+      using string_type = std::basic_string<CharT, Traits>;
+
+      static async_writer& instance() {
+	 static async_writer writer;
+	 return writer;
+      }
+      /* fetch a recycled formatting buffer, if available */
+      string_type acquire() {
+	 std::lock_guard<std::mutex> lock(mutex);
+	 if (pool.empty()) return string_type();
+	 string_type buffer = std::move(pool.back());
+	 pool.pop_back();
+	 return buffer;
+      }
+      /* return an unused formatting buffer to the pool */
+      void recycle(string_type&& buffer) {
+	 std::lock_guard<std::mutex> lock(mutex);
+	 if (pool.size() < max_pooled) {
+	    buffer.clear();
+	    pool.push_back(std::move(buffer));
+	 }
+      }
+      /* hand formatted text over to the background thread;
+	 blocks when the queue is full */
+      void enqueue(std::basic_ostream<CharT, Traits>& out,
+	    string_type&& text) {
+	 std::unique_lock<std::mutex> lock(mutex);
+	 if (!running) {
+	    writer_thread = std::thread(&async_writer::run, this);
+	    running = true;
+	 }
+	 while (queue.size() >= max_queued) {
+	    not_full.wait(lock);
+	 }
+	 queue.emplace_back(&out, std::move(text));
+	 ++in_flight;
+	 not_empty.notify_one();
+      }
+      /* wait until all enqueued output has reached its target stream */
+      void flush() {
+	 std::unique_lock<std::mutex> lock(mutex);
+	 while (in_flight > 0) {
+	    drained.wait(lock);
+	 }
+      }
+      ~async_writer() {
+	 {
+	    std::lock_guard<std::mutex> lock(mutex);
+	    done = true;
+	    not_empty.notify_one();
+	 }
+	 if (writer_thread.joinable()) writer_thread.join();
+      }
+   private:
+      async_writer() {
+      }
+      void run() {
+	 std::unique_lock<std::mutex> lock(mutex);
+	 for (;;) {
+	    while (queue.empty() && !done) {
+	       not_empty.wait(lock);
+	    }
+	    if (queue.empty()) break; /* done and fully drained */
+	    /* grab the whole batch and write without holding the lock */
+	    std::deque<entry> batch;
+	    batch.swap(queue);
+	    not_full.notify_all();
+	    lock.unlock();
+	    for (auto& e: batch) {
+	       e.out->rdbuf()->sputn(e.text.data(), e.text.size());
+	    }
+	    lock.lock();
+	    in_flight -= batch.size();
+	    for (auto& e: batch) {
+	       if (pool.size() < max_pooled) {
+		  e.text.clear();
+		  pool.push_back(std::move(e.text));
+	       }
+	    }
+	    if (in_flight == 0) drained.notify_all();
+	 }
+      }
+      struct entry {
+	 entry(std::basic_ostream<CharT, Traits>* out, string_type&& text) :
+	    out(out), text(std::move(text)) {
+	 }
+	 std::basic_ostream<CharT, Traits>* out;
+	 string_type text;
+      };
+      static constexpr std::size_t max_queued = 1024;
+      static constexpr std::size_t max_pooled = 64;
+      std::mutex mutex;
+      std::condition_variable not_empty;
+      std::condition_variable not_full;
+      std::condition_variable drained;
+      std::deque<entry> queue;
+      std::vector<string_type> pool;
+      std::size_t in_flight = 0;
+      bool running = false;
+      bool done = false;
+      std::thread writer_thread;
+};
+
+#if defined(__unix__)
+/* flush a gathered iovec array to the given file descriptor in
+   bounded writev batches; partial writes are continued, even
+   within a span; false is returned in case of errors */
+inline bool writev_all(int fd, std::vector<struct iovec>& iov) {
+   constexpr std::size_t max_iovcnt = 64;
+   std::size_t i = 0;
+   while (i < iov.size()) {
+      std::size_t iovcnt = iov.size() - i;
+      if (iovcnt > max_iovcnt) iovcnt = max_iovcnt;
+      ssize_t written = ::writev(fd, iov.data() + i,
+	 static_cast<int>(iovcnt));
+      if (written < 0) {
+	 if (errno == EINTR) continue;
+	 return false;
+      }
+      while (i < iov.size() &&
+	    written >= static_cast<ssize_t>(iov[i].iov_len)) {
+	 written -= iov[i].iov_len; ++i;
+      }
+      if (written > 0) {
+	 iov[i].iov_base = static_cast<char*>(iov[i].iov_base) + written;
+	 iov[i].iov_len -= written;
+      }
+   }
+   return true;
+}
+#endif
+
 } // namespace impl
 
+/* snapshot of the per-thread instrumentation counters; all
+   zeroes unless compiled with -DFMT_PRINTF_STATS */
+inline printf_stats stats() {
+#if defined(FMT_PRINTF_STATS)
+   return impl::stats_counters();
+#else
+   return printf_stats();
+#endif
+}
+
+/* reset the per-thread instrumentation counters, e.g. at the
+   begin of a measurement interval */
+inline void stats_reset() {
+#if defined(FMT_PRINTF_STATS)
+   impl::stats_counters() = printf_stats();
+#endif
+}
+
 template<typename CharT, typename Traits, typename... Values>
 inline int printf(std::basic_ostream<CharT, Traits>& out,
       const CharT* format) {
@@ -1195,112 +2467,649 @@ inline int printf(std::basic_ostream<CharT, Traits>& out,
       cout.write(fseg.beginp, fseg.endp - fseg.beginp);
       format = fseg.nextp;
    }
+   cout.flush_buffer();
+   if (!cout) return -1;
    return cout.get_count();
 }
 
 template<typename CharT, typename Traits, typename... Values>
 inline int printf(std::basic_ostream<CharT, Traits>& out,
       const CharT* format, Values&&... values) {
+   impl::scratch_guard arena_guard;
    impl::counting_ostream<CharT, Traits> cout(out);
-   if (cout.getloc() != std::locale::classic()) {
-      cout.imbue(std::locale(cout.getloc(), new impl::suppress_grouping()));
+   std::tuple<Values&...> tuple(values...);
+
+   /* pre-pass: compile the whole format into a plan of segments
+      with width and precision already resolved; positional
+      formats with dynamic fields are then executed in one tight
+      loop below with exactly one tuple dispatch per segment;
+      most formats fit into the inline array, larger ones draw
+      from the per-thread arena */
+   constexpr impl::integer inline_segments = 8;
+   impl::format_segment<CharT> plan[inline_segments];
+   impl::format_segment<CharT>* segments = plan;
+   impl::integer capacity = inline_segments;
+   impl::integer nof_segments = 0;
+   impl::integer nof_args = 0;
+   while (format) {
+      if (nof_segments == capacity) {
+	 capacity *= 2;
+	 impl::scratch_buffer<impl::format_segment<CharT>> spill(capacity);
+	 for (impl::integer i = 0; i < nof_segments; ++i) {
+	    spill.data()[i] = segments[i];
+	 }
+	 segments = spill.data();
+      }
+      auto& fseg = segments[nof_segments];
+      fseg = impl::parse_format_segment(format, nof_args);
+      if (!fseg.valid) return -1;
+      nof_args += fseg.nof_args;
+      if (fseg.width_index >= 0) {
+	 fseg.width = impl::get_value(tuple, fseg.width_index);
+	 fseg.width_index = -1;
+      }
+      if (fseg.precision_index >= 0) {
+	 fseg.precision = impl::get_value(tuple, fseg.precision_index);
+	 fseg.precision_index = -1;
+      }
+      ++nof_segments;
+      format = fseg.nextp;
+   }
+   for (impl::integer i = 0; i < nof_segments; ++i) {
+      if (!impl::process_segment(cout, tuple, segments[i])) return -1;
+   }
+   cout.flush_buffer();
+   if (!cout) return -1;
+   return cout.get_count();
+}
+
+template<typename... Values>
+inline int printf(const char* format, Values&&... values) {
+   return printf(std::cout, format, std::forward<Values>(values)...);
+}
+
+template<typename... Values>
+inline int printf(const wchar_t* format, Values&&... values) {
+   return printf(std::wcout, format, std::forward<Values>(values)...);
+}
+
+#if defined(__unix__)
+/* variant of fmt::printf which writes to a POSIX file descriptor,
+   comparable to dprintf(3); the literal stretches of the format
+   are gathered zero-copy, all conversions are formatted into one
+   in-memory buffer, and everything reaches the kernel through as
+   few writev(2) calls as possible instead of one write per line
+   or even per segment; the C locale applies as with std::printf;
+   the number of bytes written is returned, -1 in case of errors */
+template<typename... Values>
+inline int dprintf(int fd, const char* format) {
+   std::vector<struct iovec> iov;
+   std::size_t total = 0;
+   while (format) {
+      auto fseg = impl::parse_format_segment(format, 0);
+      if (!fseg.valid) return -1;
+      if (fseg.nof_args > 0) return -1;
+      if (fseg.endp > fseg.beginp) {
+	 std::size_t len = fseg.endp - fseg.beginp;
+	 iov.push_back({const_cast<char*>(fseg.beginp), len});
+	 total += len;
+      }
+      format = fseg.nextp;
    }
+   if (!impl::writev_all(fd, iov)) return -1;
+   return static_cast<int>(total);
+}
+
+template<typename... Values>
+inline int dprintf(int fd, const char* format, Values&&... values) {
+   impl::scratch_guard arena_guard;
    std::tuple<Values&...> tuple(values...);
+   impl::string_ostreambuf<char> sbuf;
+   std::basic_ostream<char> os(&sbuf);
+   impl::counting_ostream<char> cout(os);
+   /* spans with base pointing into the format string (zero-copy)
+      or, if base is null, with an offset into the conversion
+      buffer which may still grow and move while we gather */
+   struct span {
+      const char* base;
+      std::size_t offset;
+      std::size_t len;
+   };
+   std::vector<span> spans;
    impl::integer nof_args = 0;
+   std::size_t total = 0;
    while (format) {
       auto fseg = impl::parse_format_segment(format, nof_args);
       if (!fseg.valid) return -1;
       nof_args += fseg.nof_args;
       if (fseg.endp > fseg.beginp) {
-	 cout.write(fseg.beginp, fseg.endp - fseg.beginp);
-	 if (!cout) return -1;
+	 std::size_t len = fseg.endp - fseg.beginp;
+	 spans.push_back({fseg.beginp, 0, len});
+	 total += len;
       }
       if (fseg.value_index >= 0) {
 	 if (fseg.conversion == 'n') {
 	    if (impl::set_value(tuple, fseg.value_index,
-		  cout.get_count()) < 0) {
+		  static_cast<std::streamsize>(total)) < 0) {
 	       return -1;
 	    }
 	 } else {
-	    if (fseg.width_index >= 0) {
-	       fseg.width = impl::get_value(tuple, fseg.width_index);
-	    }
-	    if (fseg.precision_index >= 0) {
-	       fseg.precision = impl::get_value(tuple, fseg.precision_index);
-	    }
-	    impl::format_saver<CharT, Traits> fsaver(cout);
-	    cout.setf(fseg.fmtflags);
-	    cout.setf(fseg.base == 8? std::ios_base::oct  :
-		      fseg.base == 10? std::ios_base::dec :
-		      fseg.base == 16? std::ios_base::hex :
-		      std::ios_base::fmtflags(0), std::ios_base::basefield);
-	    if (fseg.width > 0) {
-	       cout.width(fseg.width);
-	    }
-	    if ((fseg.flags & impl::precision) && fseg.precision >= 0) {
-	       cout.precision(fseg.precision);
-	    }
-	    if (fseg.flags & impl::grouping_flag) {
-	       cout.imbue(std::locale(cout.getloc(),
-		  new impl::thousands_grouping()));
-	    }
-	    if (!process_value(tuple, fseg.value_index, cout, fseg)) {
-	       return -1;
+	    fseg.beginp = fseg.endp; /* literal already gathered */
+	    std::size_t before = sbuf.size();
+	    if (!impl::process_segment(cout, tuple, fseg)) return -1;
+	    cout.flush_buffer();
+	    if (!cout) return -1;
+	    std::size_t len = sbuf.size() - before;
+	    if (len > 0) {
+	       spans.push_back({nullptr, before, len});
+	       total += len;
 	    }
 	 }
       }
       format = fseg.nextp;
    }
-   return cout.get_count();
+   /* the conversion buffer no longer moves, resolve the offsets
+      and flush everything with bounded writev batches */
+   const char* cbase = sbuf.data();
+   std::vector<struct iovec> iov(spans.size());
+   for (std::size_t i = 0; i < spans.size(); ++i) {
+      const char* base = spans[i].base?
+	 spans[i].base: cbase + spans[i].offset;
+      iov[i].iov_base = const_cast<char*>(base);
+      iov[i].iov_len = spans[i].len;
+   }
+   if (!impl::writev_all(fd, iov)) return -1;
+   return static_cast<int>(total);
 }
+#endif
 
-template<typename... Values>
-inline int printf(const char* format, Values&&... values) {
-   return printf(std::cout, format, std::forward<Values>(values)...);
+/* pre-compiled format string where the format is parsed just
+   once such that it can be applied many times afterwards;
+   see fmt::compile below for a convenient way to create
+   such objects */
+template<typename CharT, typename Traits = std::char_traits<CharT>>
+class basic_compiled_format {
+   public:
+      basic_compiled_format() : ok(false) {
+      }
+      basic_compiled_format(const CharT* format_string) : ok(false) {
+	 if (format_string) format = format_string;
+	 parse();
+      }
+      /* the parsed segments point into our copy of the format
+	 string; hence we re-parse whenever we are copied or moved */
+      basic_compiled_format(const basic_compiled_format& other) :
+	    format(other.format), ok(false) {
+	 parse();
+      }
+      basic_compiled_format& operator=(const basic_compiled_format& other) {
+	 format = other.format;
+	 parse();
+	 return *this;
+      }
+      /* return true if the format string has been parsed successfully */
+      bool valid() const {
+	 return ok;
+      }
+      /* print to out on base of the pre-parsed format;
+	 this is equivalent to fmt::printf(out, format) */
+      int operator()(std::basic_ostream<CharT, Traits>& out) const {
+	 if (!ok) return -1;
+	 impl::counting_ostream<CharT, Traits> cout(out);
+	 for (const auto& fseg: segments) {
+	    if (fseg.nof_args > 0) return -1;
+	    cout.write(fseg.beginp, fseg.endp - fseg.beginp);
+	 }
+	 cout.flush_buffer();
+	 if (!cout) return -1;
+	 return cout.get_count();
+      }
+      /* print to out on base of the pre-parsed format;
+	 this is equivalent to fmt::printf(out, format, values...) */
+      template<typename... Values>
+      int operator()(std::basic_ostream<CharT, Traits>& out,
+	    Values&&... values) const {
+	 if (!ok) return -1;
+	 impl::scratch_guard arena_guard;
+	 impl::counting_ostream<CharT, Traits> cout(out);
+	 std::tuple<Values&...> tuple(values...);
+	 for (const auto& fseg: segments) {
+	    if (!impl::process_segment(cout, tuple, fseg)) return -1;
+	 }
+	 cout.flush_buffer();
+	 if (!cout) return -1;
+	 return cout.get_count();
+      }
+   private:
+      void parse() {
+	 segments.clear(); ok = false;
+	 const CharT* fp = format.c_str();
+	 impl::integer nof_args = 0;
+	 while (fp) {
+	    auto fseg = impl::parse_format_segment(fp, nof_args);
+	    if (!fseg.valid) return;
+	    nof_args += fseg.nof_args;
+	    segments.push_back(fseg);
+	    fp = fseg.nextp;
+	 }
+	 ok = true;
+      }
+      std::basic_string<CharT> format;
+      std::vector<impl::format_segment<CharT>> segments;
+      bool ok;
+};
+
+using compiled_format = basic_compiled_format<char>;
+using wcompiled_format = basic_compiled_format<wchar_t>;
+
+/* parse the given format string into a pre-compiled format object;
+   fmt::compile(format)(out, values...) behaves like
+   fmt::printf(out, format, values...) but the parsing cost
+   is paid only once per format */
+template<typename CharT>
+inline basic_compiled_format<CharT> compile(const CharT* format) {
+   return basic_compiled_format<CharT>(format);
+}
+
+/* variant of fmt::printf which memoizes parsed formats in a
+   bounded per-thread cache keyed by the format text; this is
+   intended for call sites whose formats arrive at runtime, e.g.
+   from a message catalog, where the same strings repeat forever
+   but fmt::compile cannot be used; on a hit the per-call parse
+   is reduced to one hash lookup */
+template<typename CharT, typename Traits, typename... Values>
+inline int printf_cached(std::basic_ostream<CharT, Traits>& out,
+      const CharT* format, Values&&... values) {
+   if (!format) return -1;
+   using key_type = std::basic_string<CharT, Traits>;
+   thread_local std::unordered_map<key_type,
+      basic_compiled_format<CharT, Traits>> cache;
+   constexpr std::size_t max_cached = 256;
+   key_type key(format);
+   auto it = cache.find(key);
+   if (it == cache.end()) {
+      if (cache.size() == max_cached) {
+	 /* the cache is full; as caches beyond the limit hint at
+	    formats which do not actually repeat we simply start
+	    over instead of maintaining an eviction order */
+	 cache.clear();
+      }
+      it = cache.emplace(std::move(key),
+	 basic_compiled_format<CharT, Traits>(format)).first;
+   }
+   return it->second(out, std::forward<Values>(values)...);
 }
 
 template<typename... Values>
-inline int printf(const wchar_t* format, Values&&... values) {
-   return printf(std::wcout, format, std::forward<Values>(values)...);
+inline int printf_cached(const char* format, Values&&... values) {
+   return printf_cached(std::cout, format, std::forward<Values>(values)...);
 }
 
 template<typename... Values>
-inline int snprintf(char* s, std::size_t n,
-      const char* format, Values&&... values) {
-   std::ostringstream os;
+inline int printf_cached(const wchar_t* format, Values&&... values) {
+   return printf_cached(std::wcout, format, std::forward<Values>(values)...);
+}
+
+/* print a sequence of rows which all share one format;
+   the iterator range is expected to deliver std::tuple values
+   (or anything else supporting std::get and std::tuple_size)
+   whose elements serve as the arguments of the format;
+   the format is parsed just once and stream and locale are
+   set up just once such that all per-call fixed costs of
+   fmt::printf are amortized across the whole batch;
+   the total number of bytes written is returned,
+   -1 in case of errors */
+template<typename CharT, typename Traits, typename InputIterator>
+inline int print_rows(std::basic_ostream<CharT, Traits>& out,
+      const CharT* format, InputIterator first, InputIterator last) {
+   impl::scratch_guard arena_guard;
+   impl::counting_ostream<CharT, Traits> cout(out);
+   std::vector<impl::format_segment<CharT>> segments;
+   const CharT* fp = format;
+   impl::integer nof_args = 0;
+   while (fp) {
+      auto fseg = impl::parse_format_segment(fp, nof_args);
+      if (!fseg.valid) return -1;
+      nof_args += fseg.nof_args;
+      segments.push_back(fseg);
+      fp = fseg.nextp;
+   }
+   for (InputIterator it = first; it != last; ++it) {
+      const auto& row = *it;
+      for (const auto& fseg: segments) {
+	 if (!impl::process_segment(cout, row, fseg)) return -1;
+      }
+   }
+   cout.flush_buffer();
+   if (!cout) return -1;
+   return cout.get_count();
+}
+
+/* variant of fmt::printf which formats eagerly but delegates the
+   actual write into the stream buffer of out to a background
+   thread; this takes the write out of the critical path of the
+   caller at the expense that write errors can no longer be
+   reported; the caller has to make sure that out lives until the
+   output has been flushed, see fmt::async_flush below; the number
+   of bytes formatted is returned, -1 in case of errors */
+template<typename CharT, typename Traits, typename... Values>
+inline int printf_async(std::basic_ostream<CharT, Traits>& out,
+      const CharT* format, Values&&... values) {
+   auto& writer = impl::async_writer<CharT, Traits>::instance();
+   impl::string_ostreambuf<CharT, Traits> sbuf(writer.acquire());
+   std::basic_ostream<CharT, Traits> os(&sbuf);
+   os.imbue(out.getloc());
    int nbytes = printf(os, format, std::forward<Values>(values)...);
-   if (nbytes < 0) return nbytes;
-   if (n == 0) return nbytes;
-   std::string result(os.str());
-   if (static_cast<std::size_t>(nbytes) + 1 <= n) {
-      std::strcpy(s, result.c_str());
-      return nbytes;
-   } else {
-      std::strcpy(s, result.substr(0, n-1).c_str());
-      s[n-1] = 0;
-      return n-1;
+   if (nbytes < 0) {
+      writer.recycle(sbuf.str());
+      return -1;
    }
+   writer.enqueue(out, sbuf.str());
+   return nbytes;
 }
 
-template<typename... Values>
-inline int snprintf(wchar_t* s, std::size_t n,
-      const wchar_t* format, Values&&... values) {
-   std::wostringstream os;
+/* wait until all output enqueued by fmt::printf_async for
+   streams of the given character type has reached its target */
+template<typename CharT = char, typename Traits = std::char_traits<CharT>>
+inline void async_flush() {
+   impl::async_writer<CharT, Traits>::instance().flush();
+}
+
+/* sink which permits concurrent fmt::printf-style calls from
+   multiple threads to one shared stream; every thread formats
+   independently through the regular machinery and the completed
+   text is published through a lock-free multi-producer ring
+   (following Dmitry Vyukov's bounded queue); just the final
+   byte-copy into the target streambuf is serialized, performed
+   by whichever thread happens to drain the ring */
+template<typename CharT, typename Traits = std::char_traits<CharT>>
+class basic_concurrent_sink {
+   public:
+      using string_type = std::basic_string<CharT, Traits>;
+
+      explicit basic_concurrent_sink(std::basic_ostream<CharT, Traits>& out) :
+	    target(*out.rdbuf()), loc(out.getloc()),
+	    enqueue_pos(0), dequeue_pos(0) {
+	 for (std::size_t i = 0; i < ring_size; ++i) {
+	    ring[i].sequence.store(i, std::memory_order_relaxed);
+	 }
+	 draining.clear();
+      }
+      ~basic_concurrent_sink() {
+	 flush();
+      }
+      basic_concurrent_sink(const basic_concurrent_sink&) = delete;
+      basic_concurrent_sink& operator=(const basic_concurrent_sink&) = delete;
+
+      /* format and publish one output chunk; the number of bytes
+	 formatted is returned, -1 in case of formatting errors;
+	 errors of the deferred write cannot be reported */
+      template<typename... Values>
+      int printf(const CharT* format, Values&&... values) {
+	 impl::string_ostreambuf<CharT, Traits> sbuf;
+	 std::basic_ostream<CharT, Traits> os(&sbuf);
+	 os.imbue(loc);
+	 int nbytes = fmt::printf(os, format,
+	    std::forward<Values>(values)...);
+	 if (nbytes < 0) return -1;
+	 publish(sbuf.str());
+	 return nbytes;
+      }
+      /* write out everything published so far and sync the target;
+	 to be called when the producers are known to be quiet,
+	 e.g. after they have been joined */
+      void flush() {
+	 while (dequeue_pos.load(std::memory_order_acquire) <
+	       enqueue_pos.load(std::memory_order_acquire)) {
+	    if (!try_drain()) std::this_thread::yield();
+	 }
+	 target.pubsync();
+      }
+   private:
+      struct slot {
+	 std::atomic<std::size_t> sequence;
+	 string_type text;
+      };
+
+      void publish(string_type&& text) {
+	 for (;;) {
+	    std::size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+	    slot& s = ring[pos & (ring_size - 1)];
+	    std::size_t seq = s.sequence.load(std::memory_order_acquire);
+	    auto dif = static_cast<std::ptrdiff_t>(seq - pos);
+	    if (dif == 0) {
+	       if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+		     std::memory_order_relaxed)) {
+		  s.text = std::move(text);
+		  s.sequence.store(pos + 1, std::memory_order_release);
+		  /* opportunistically become the consumer */
+		  try_drain();
+		  return;
+	       }
+	    } else if (dif < 0) {
+	       /* the ring is full; help draining or wait for
+		  the active consumer to make room */
+	       if (!try_drain()) std::this_thread::yield();
+	    }
+	 }
+      }
+      /* drain published entries into the target streambuf;
+	 at most one thread acts as consumer at any time;
+	 false is returned if another thread holds that role */
+      bool try_drain() {
+	 if (draining.test_and_set(std::memory_order_acquire)) {
+	    return false;
+	 }
+	 for (;;) {
+	    std::size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+	    slot& s = ring[pos & (ring_size - 1)];
+	    std::size_t seq = s.sequence.load(std::memory_order_acquire);
+	    if (static_cast<std::ptrdiff_t>(seq - (pos + 1)) != 0) break;
+	    target.sputn(s.text.data(), s.text.size());
+	    s.text.clear();
+	    s.sequence.store(pos + ring_size, std::memory_order_release);
+	    dequeue_pos.store(pos + 1, std::memory_order_release);
+	 }
+	 draining.clear(std::memory_order_release);
+	 return true;
+      }
+
+      static constexpr std::size_t ring_size = 256; /* power of two */
+      std::basic_streambuf<CharT, Traits>& target;
+      std::locale loc;
+      slot ring[ring_size];
+      std::atomic<std::size_t> enqueue_pos;
+      std::atomic<std::size_t> dequeue_pos;
+      std::atomic_flag draining = ATOMIC_FLAG_INIT;
+};
+
+using concurrent_sink = basic_concurrent_sink<char>;
+using wconcurrent_sink = basic_concurrent_sink<wchar_t>;
+
+#if __cplusplus >= 201703L && defined(__GNUC__)
+/* carry a format string literal as template parameter such that
+   the compatibility of format and arguments can be checked at
+   compile time, e.g. "x = %d\n"_fmt(std::cout, x);
+   note that string literal operator templates are an extension
+   of gcc and clang */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+template<typename CharT, CharT... cs>
+struct constexpr_format {
+   static constexpr CharT text[sizeof...(cs) + 1] = {cs..., 0};
+   /* as the format is known at compile time, all segments are
+      parsed as constexpr values and each argument is fetched
+      through std::get with a constant index; the runtime tuple
+      dispatch and the per-call parse of fmt::printf vanish
+      completely and the flag tests on the constexpr segment are
+      foldable by the compiler */
+   template<typename... Values>
+   int operator()(std::basic_ostream<CharT>& out,
+	 Values&&... values) const {
+      static_assert(impl::format_compatible<Values...>(text),
+	 "format string does not match the given arguments");
+      impl::scratch_guard arena_guard;
+      impl::counting_ostream<CharT> cout(out);
+      std::tuple<Values&...> tuple(values...);
+      if (!emit<0, 0>(cout, tuple)) return -1;
+      cout.flush_buffer();
+      if (!cout) return -1;
+      return cout.get_count();
+   }
+   private:
+      template<std::size_t Offset, impl::integer NofArgs, typename Tuple>
+      bool emit(impl::counting_ostream<CharT>& cout, Tuple& tuple) const {
+	 constexpr auto fseg = impl::parse_format_segment(text + Offset,
+	    NofArgs);
+	 static_assert(fseg.valid,
+	    "format string is invalid"); /* caught by the assert above */
+	 FMT_PRINTF_COUNT(segments_processed, 1);
+	 if (fseg.endp > fseg.beginp) {
+	    cout.write(fseg.beginp, fseg.endp - fseg.beginp);
+	    if (!cout) return false;
+	 }
+	 if constexpr (fseg.value_index >= 0) {
+	    if constexpr (fseg.conversion == 'n') {
+	       if (impl::set_value(tuple, fseg.value_index,
+		     cout.get_count()) < 0) {
+		  return false;
+	       }
+	    } else {
+	       auto seg = fseg;
+	       if constexpr (fseg.width_index >= 0) {
+		  seg.width = impl::get_value(tuple, fseg.width_index);
+		  seg.width_index = -1;
+	       }
+	       if constexpr (fseg.precision_index >= 0) {
+		  seg.precision = impl::get_value(tuple,
+		     fseg.precision_index);
+		  seg.precision_index = -1;
+	       }
+	       if (!impl::emit_conversion(cout, seg,
+		     std::get<static_cast<std::size_t>(fseg.value_index)>(
+			tuple))) {
+		  return false;
+	       }
+	    }
+	 }
+	 if constexpr (fseg.nextp != nullptr) {
+	    return emit<static_cast<std::size_t>(fseg.nextp - text),
+	       NofArgs + fseg.nof_args>(cout, tuple);
+	 } else {
+	    return true;
+	 }
+      }
+};
+
+inline namespace literals {
+   template<typename CharT, CharT... cs>
+   constexpr constexpr_format<CharT, cs...> operator""_fmt() {
+      return {};
+   }
+}
+#pragma GCC diagnostic pop
+#endif
+
+template<typename CharT, typename... Values>
+inline int snprintf(CharT* s, std::size_t n,
+      const CharT* format, Values&&... values) {
+   /* format directly into the caller-supplied buffer,
+      reserving one position for the terminating null byte;
+      excess output is counted but discarded */
+   impl::fixed_ostreambuf<CharT> sbuf(s, n > 0? n - 1: 0);
+   std::basic_ostream<CharT> os(&sbuf);
    int nbytes = printf(os, format, std::forward<Values>(values)...);
    if (nbytes < 0) return nbytes;
    if (n == 0) return nbytes;
-   std::wstring result(os.str());
    if (static_cast<std::size_t>(nbytes) + 1 <= n) {
-      std::wcscpy(s, result.c_str());
+      s[nbytes] = 0;
       return nbytes;
    } else {
-      std::wcscpy(s, result.substr(0, n-1).c_str());
-      s[n] = 0;
+      s[n-1] = 0;
       return n-1;
    }
 }
 
+/* variant of fmt::snprintf which delivers the formatted text
+   as std::basic_string instead of filling a caller-supplied
+   buffer; in case of errors an empty string is returned */
+template<typename CharT, typename... Values>
+inline std::basic_string<CharT> sprintf(const CharT* format,
+      Values&&... values) {
+   impl::string_ostreambuf<CharT> sbuf;
+   std::basic_ostream<CharT> os(&sbuf);
+   if (printf(os, format, std::forward<Values>(values)...) < 0) {
+      return std::basic_string<CharT>();
+   }
+   return sbuf.str();
+}
+
+/* result of fmt::format_to: the output iterator advanced past
+   the last character written and the number of characters,
+   -1 in case of errors */
+template<typename OutputIt>
+struct format_to_result {
+   OutputIt out;
+   int count;
+};
+
+/* variant of fmt::printf which formats through an output
+   iterator, e.g. a char* into a preallocated message frame or
+   a std::back_insert_iterator; no terminating null byte is
+   appended and the caller is responsible for providing enough
+   room; in case of errors count is -1 and out may have been
+   advanced by a partial result */
+template<typename OutputIt, typename CharT, typename... Values>
+inline format_to_result<OutputIt> format_to(OutputIt out,
+      const CharT* format, Values&&... values) {
+   impl::iterator_ostreambuf<OutputIt, CharT> sbuf(out);
+   std::basic_ostream<CharT> os(&sbuf);
+   int nbytes = printf(os, format, std::forward<Values>(values)...);
+   return {sbuf.get_iterator(), nbytes};
+}
+
+/* ostream for allocation-free in-memory formatting: output is
+   assembled in an inline buffer of N characters and spills to
+   the heap only beyond that; it plugs into the regular
+   fmt::printf(out, format, values...) overload and into plain
+   <<-operators alike; data()/size() give access to the text
+   without allocating, str() moves it out as std::basic_string
+   and leaves the stream empty */
+template<typename CharT, std::size_t N = 256,
+   typename Traits = std::char_traits<CharT>>
+class memory_stream : public std::basic_ostream<CharT, Traits> {
+   public:
+      memory_stream() : std::basic_ostream<CharT, Traits>(&sbuf) {
+      }
+      const CharT* data() {
+	 return sbuf.data();
+      }
+      std::size_t size() const {
+	 return sbuf.size();
+      }
+      std::basic_string<CharT, Traits> str() {
+	 return sbuf.str();
+      }
+   private:
+      impl::string_ostreambuf<CharT, Traits, N> sbuf;
+};
+
 } // namespace fmt
 
+#if __cplusplus >= 201703L
+/* variant of fmt::printf(out, format, values...) for cases where
+   the format is given as a string literal; the format is then
+   checked against the given arguments at compile time such that
+   mismatches no longer surface as -1 return values at runtime */
+#define FMT_PRINTF(out, format, ...) \
+   ([&](auto&&... fmt_printf_values) -> int { \
+      static_assert(fmt::impl::format_compatible< \
+	    decltype(fmt_printf_values)...>(format), \
+	 "format string does not match the given arguments"); \
+      return fmt::printf(out, format, \
+	 std::forward<decltype(fmt_printf_values)>(fmt_printf_values)...); \
+   }(__VA_ARGS__))
+#endif
+
 #endif // of #if __cplusplus < 201103L #else ...
 #endif // of #ifndef FMT_PRINTF_HPP
@@ -37,10 +37,23 @@
 #include <cstdio>
 #include <cstring>
 #include <cwchar>
+#include <iterator>
 #include <limits>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <type_traits>
+#include <vector>
+#if defined(__unix__)
+#include <unistd.h> /* for the fmt::dprintf testcases */
+#endif
+#ifdef FMT_TIMING
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <map>
+#endif
 #include "printf.hpp"
 
 #ifdef __INTEL_COMPILER
@@ -93,6 +106,123 @@ int compare(const wchar_t* s1, const wchar_t* s2) {
    return std::wcscmp(s1, s2);
 }
 
+#ifdef FMT_TIMING
+/* performance regression harness, see 'make perfcheck': the
+   regular corpus is re-run with timing enabled, every testcase is
+   measured and accumulated per conversion class, and the result
+   is compared against the baseline stored in perfcheck.baseline;
+   remove that file to record a new baseline */
+struct perf_bucket {
+   const char* name;
+   long long ns;
+   long long calls;
+};
+perf_bucket perf_buckets[] = {
+   {"integer", 0, 0},
+   {"float", 0, 0},
+   {"string", 0, 0},
+   {"char", 0, 0},
+   {"pointer", 0, 0},
+   {"literal", 0, 0},
+   {"wide", 0, 0},
+};
+
+/* classify a format by its first conversion specifier */
+perf_bucket& perf_bucket_of(const char* format) {
+   for (const char* p = format; *p; ++p) {
+      if (*p != '%') continue;
+      ++p;
+      if (!*p || *p == '%') continue;
+      /* skip flags, width, precision, and length modifiers */
+      while (*p && !std::isalpha(static_cast<unsigned char>(*p))) ++p;
+      while (*p && std::strchr("hlLjzt", *p)) ++p;
+      switch (*p) {
+	 case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+	    return perf_buckets[0];
+	 case 'a': case 'A': case 'e': case 'E':
+	 case 'f': case 'F': case 'g': case 'G':
+	    return perf_buckets[1];
+	 case 's': case 'S':
+	    return perf_buckets[2];
+	 case 'c': case 'C':
+	    return perf_buckets[3];
+	 case 'p':
+	    return perf_buckets[4];
+	 default:
+	    break; /* %n or unknown: keep looking */
+      }
+      if (!*p) break;
+   }
+   return perf_buckets[5];
+}
+
+perf_bucket& perf_bucket_of(const wchar_t*) {
+   return perf_buckets[6];
+}
+
+template<typename CharT, typename... Values>
+void time_case(const CharT* format, Values&&... values) {
+   using namespace std::chrono;
+   constexpr int reps = 32;
+   std::basic_ostringstream<CharT> os;
+   auto t0 = steady_clock::now();
+   for (int i = 0; i < reps; ++i) {
+      os.str(std::basic_string<CharT>());
+      fmt::printf(os, format, values...);
+   }
+   auto t1 = steady_clock::now();
+   auto& bucket = perf_bucket_of(format);
+   bucket.ns += duration_cast<nanoseconds>(t1 - t0).count();
+   bucket.calls += reps;
+}
+
+/* compare the accumulated timings against the stored baseline;
+   the exit status signals regressions beyond the tolerance */
+int perf_report() {
+   const char* baseline_file = "perfcheck.baseline";
+   constexpr double tolerance = 1.25; /* fail beyond +25% per class */
+   std::map<std::string, double> baseline;
+   {
+      std::ifstream in(baseline_file);
+      std::string name; double ns_per_call;
+      while (in >> name >> ns_per_call) {
+	 baseline[name] = ns_per_call;
+      }
+   }
+   if (baseline.empty()) {
+      std::ofstream out(baseline_file);
+      for (const auto& bucket: perf_buckets) {
+	 if (bucket.calls == 0) continue;
+	 out << bucket.name << " " <<
+	    static_cast<double>(bucket.ns) / bucket.calls << "\n";
+      }
+      fmt::printf("baseline recorded in %s\n", baseline_file);
+      return 0;
+   }
+   int regressions = 0;
+   for (const auto& bucket: perf_buckets) {
+      if (bucket.calls == 0) continue;
+      double ns_per_call = static_cast<double>(bucket.ns) / bucket.calls;
+      auto it = baseline.find(bucket.name);
+      if (it == baseline.end()) {
+	 fmt::printf("%-8s %10.1f ns/call (not in baseline)\n",
+	    bucket.name, ns_per_call);
+	 continue;
+      }
+      bool regressed = ns_per_call > it->second * tolerance;
+      fmt::printf("%-8s %10.1f ns/call baseline %10.1f %s\n",
+	 bucket.name, ns_per_call, it->second,
+	 regressed? "REGRESSED": "ok");
+      if (regressed) ++regressions;
+   }
+   if (regressions > 0) {
+      fmt::printf("%d conversion classes regressed beyond +%d%%\n",
+	 regressions, static_cast<int>((tolerance - 1) * 100 + 0.5));
+   }
+   return regressions > 0? 1: 0;
+}
+#endif
+
 template<typename... Values>
 int print(const char* format, Values&&... values) {
    return fmt::printf(std::cout, format, std::forward<Values>(values)...);
@@ -271,6 +401,10 @@ bool general_testcase(bool implementation_defined,
       bool to_string, int string_len,
       const CharT* format, Values&&... values) {
    ++testcases;
+#ifdef FMT_TIMING
+   /* the offset cases are skipped as repeating %n has side effects */
+   if (!with_offset) time_case(format, values...);
+#endif
    std::basic_ostringstream<CharT> os;
    errno = 0;
    int off1 = 0; int off2 = 0;
@@ -424,6 +558,72 @@ bool special_testcase(int expected_count,
    }
 }
 
+void compiled_mismatch(const char* format) {
+   print("compiled format test for \"%s\" fails\n", format);
+}
+
+void compiled_mismatch(const wchar_t* format) {
+   print(L"compiled format test for \"%s\" fails\n", format);
+}
+
+/* check that a format pre-compiled through fmt::compile delivers
+   the very same results as fmt::printf, even when reused */
+template<typename CharT, typename... Values>
+bool compiled_testcase(const CharT* format, Values&&... values) {
+   ++testcases;
+   std::basic_ostringstream<CharT> os1;
+   auto count1 = fmt::printf(os1, format, std::forward<Values>(values)...);
+   auto cf = fmt::compile(format);
+   std::basic_ostringstream<CharT> os2;
+   auto count2 = cf(os2, std::forward<Values>(values)...);
+   bool ok = count1 == count2 && os1.str() == os2.str();
+   if (ok && count1 >= 0) {
+      /* a compiled format must be reusable */
+      std::basic_ostringstream<CharT> os3;
+      ok = cf(os3, std::forward<Values>(values)...) == count1 &&
+	 os3.str() == os1.str();
+   }
+   if (ok) {
+      ++successful;
+   } else {
+      compiled_mismatch(format);
+      print_values(1, values...);
+   }
+   return ok;
+}
+
+void sprintf_mismatch(const char* format) {
+   print("fmt::sprintf test for \"%s\" fails\n", format);
+}
+
+void sprintf_mismatch(const wchar_t* format) {
+   print(L"fmt::sprintf test for \"%s\" fails\n", format);
+}
+
+/* check that fmt::sprintf delivers the very same text as
+   fmt::printf into an ostringstream and an empty string in
+   case of errors */
+template<typename CharT, typename... Values>
+bool sprintf_testcase(const CharT* format, Values&&... values) {
+   ++testcases;
+   std::basic_ostringstream<CharT> os;
+   auto count = fmt::printf(os, format, std::forward<Values>(values)...);
+   auto result = fmt::sprintf(format, std::forward<Values>(values)...);
+   bool ok;
+   if (count < 0) {
+      ok = result.empty();
+   } else {
+      ok = result == os.str();
+   }
+   if (ok) {
+      ++successful;
+   } else {
+      sprintf_mismatch(format);
+      print_values(1, values...);
+   }
+   return ok;
+}
+
 /* for tests of the support for output operators */
 template<typename T>
 struct TestObject {
@@ -452,6 +652,9 @@ void run_tests() {
 
    /* test with many arguments of different types */
    testcase("%d %u %lg %c %s", 27, 13u, 2.3, 'x', "Hello");
+   /* enough arguments to exceed the unrolled switch dispatch */
+   testcase("%d %d %d %d %d %d %d %d %d %d",
+      1, 2, 3, 4, 5, 6, 7, 8, 9, 10);
 
    char c_values[] = {'a', 'A', '.', '/', ' ', '\t', '\n', '\0',
       std::numeric_limits<char>::min(), std::numeric_limits<char>::max()};
@@ -1250,11 +1453,432 @@ void run_tests() {
       delete top;
    }
 
+   /* test pre-compiled format objects */
+   compiled_testcase("Hello world!");
+   compiled_testcase("%d %u %lg %c %s", 27, 13u, 2.3, 'x', "Hello");
+   compiled_testcase("%8.2f|%-8s|%#x", 3.14159, "left", 0xbeefu);
+   compiled_testcase("%2$s, %1$s", "world", "hello");
+   compiled_testcase("%*.*d", 10, 5, 42);
+   compiled_testcase("%'d", 1234567);
+   compiled_testcase(L"%d %ls", 42, L"wide");
+   {
+      /* invalid formats must be rejected once and for all */
+      ++testcases;
+      auto cf = fmt::compile("%q");
+      std::ostringstream os;
+      if (!cf.valid() && cf(os, 42) == -1) {
+	 ++successful;
+      } else {
+	 compiled_mismatch("%q");
+      }
+   }
+
+   /* fmt::print_rows must deliver the very same output as
+      repeated fmt::printf invocations with the shared format */
+   {
+      ++testcases;
+      std::vector<std::tuple<int, double, const char*>> rows;
+      rows.push_back(std::make_tuple(1, 3.25, "one"));
+      rows.push_back(std::make_tuple(-42, 0.5, "two"));
+      rows.push_back(std::make_tuple(7, 1e10, "three"));
+      const char* row_format = "%4d %10.2f %-8s\n";
+      std::ostringstream os1;
+      int count1 = 0;
+      for (const auto& row: rows) {
+	 count1 += fmt::printf(os1, row_format, std::get<0>(row),
+	    std::get<1>(row), std::get<2>(row));
+      }
+      std::ostringstream os2;
+      int count2 = fmt::print_rows(os2, row_format,
+	 rows.begin(), rows.end());
+      if (count1 == count2 && os1.str() == os2.str()) {
+	 ++successful;
+      } else {
+	 print("fmt::print_rows test fails\n");
+      }
+   }
+   /* size-aware overloads for std::basic_string values */
+   {
+      std::string str("Hello, world!");
+      special_testcase(13, "Hello, world!", "%s", str);
+      special_testcase(16, "   Hello, world!", "%16s", str);
+      special_testcase(16, "Hello, world!   ", "%-16s", str);
+      special_testcase(5, "Hello", "%.5s", str);
+      special_testcase(8, "   Hello", "%8.5s", str);
+      special_testcase(0, "", "%s", std::string());
+   }
+   {
+      ++testcases;
+      std::wstring wstr(L"wide");
+      std::wostringstream wos;
+      if (fmt::printf(wos, L"%6s|%.2s", wstr, wstr) == 9 &&
+	    wos.str() == L"  wide|wi") {
+	 ++successful;
+      } else {
+	 print("std::wstring test for L\"%%6s|%%.2s\" fails\n");
+      }
+   }
+   {
+      /* narrow strings are widened for wide streams */
+      ++testcases;
+      std::wostringstream wos;
+      if (fmt::printf(wos, L"%6s", std::string("wide")) == 6 &&
+	    wos.str() == L"  wide") {
+	 ++successful;
+      } else {
+	 print("std::string to wide stream test for L\"%%6s\" fails\n");
+      }
+   }
+   {
+      /* wide strings are converted for narrow streams */
+      ++testcases;
+      std::ostringstream os;
+      if (fmt::printf(os, "%6s", std::wstring(L"wide")) == 6 &&
+	    os.str() == "  wide") {
+	 ++successful;
+      } else {
+	 print("std::wstring to narrow stream test for \"%%6s\" fails\n");
+      }
+   }
+#if __cplusplus >= 201703L
+   {
+      std::string_view sv("Hello, world!");
+      special_testcase(5, "Hello", "%.5s", sv);
+      special_testcase(16, "   Hello, world!", "%16s", sv);
+   }
+#endif
+
+   /* fmt::printf_async must eventually deliver the very same
+      output as fmt::printf */
+   {
+      ++testcases;
+      std::ostringstream os1;
+      std::ostringstream os2;
+      int count1 = 0;
+      int count2 = 0;
+      for (int i = 0; i < 100; ++i) {
+	 count1 += fmt::printf(os1, "%3d %8.2f %s\n", i, i + 0.25, "ok");
+	 count2 += fmt::printf_async(os2, "%3d %8.2f %s\n",
+	    i, i + 0.25, "ok");
+      }
+      fmt::async_flush();
+      if (count1 == count2 && os1.str() == os2.str()) {
+	 ++successful;
+      } else {
+	 print("fmt::printf_async test fails\n");
+      }
+   }
+   {
+      /* invalid formats must be rejected synchronously */
+      ++testcases;
+      std::ostringstream os;
+      if (fmt::printf_async(os, "%q", 42) == -1) {
+	 ++successful;
+      } else {
+	 print("fmt::printf_async test for \"%%q\" fails\n");
+      }
+   }
+   /* lines printed concurrently through fmt::concurrent_sink
+      must each appear exactly once and intact */
+   {
+      ++testcases;
+      std::ostringstream os;
+      constexpr int nof_threads = 4;
+      constexpr int nof_lines = 100;
+      {
+	 fmt::concurrent_sink sink(os);
+	 std::vector<std::thread> threads;
+	 for (int t = 0; t < nof_threads; ++t) {
+	    threads.emplace_back([&sink, t]() {
+	       for (int i = 0; i < nof_lines; ++i) {
+		  sink.printf("thread %d line %06d %8.2f\n",
+		     t, i, i + 0.5);
+	       }
+	    });
+	 }
+	 for (auto& thread: threads) thread.join();
+	 sink.flush();
+      }
+      std::istringstream lines(os.str());
+      std::string line;
+      bool ok = true;
+      int total = 0;
+      while (ok && std::getline(lines, line)) {
+	 int t = 0; int i = 0; double val = 0;
+	 if (std::sscanf(line.c_str(), "thread %d line %d %lf",
+		  &t, &i, &val) == 3 &&
+	       line == fmt::sprintf("thread %d line %06d %8.2f",
+		  t, i, i + 0.5)) {
+	    ++total;
+	 } else {
+	    ok = false;
+	 }
+      }
+      if (ok && total == nof_threads * nof_lines) {
+	 ++successful;
+      } else {
+	 print("fmt::concurrent_sink test fails\n");
+      }
+   }
+   {
+      /* invalid formats must be rejected by fmt::print_rows */
+      ++testcases;
+      std::vector<std::tuple<int>> rows(1, std::make_tuple(42));
+      std::ostringstream os;
+      if (fmt::print_rows(os, "%q", rows.begin(), rows.end()) == -1) {
+	 ++successful;
+      } else {
+	 print("fmt::print_rows test for \"%%q\" fails\n");
+      }
+   }
+
+#if __cplusplus >= 201703L
+   /* compile-time checked formats */
+   {
+      ++testcases;
+      std::ostringstream os;
+      if (FMT_PRINTF(os, "%d %s", 42, "x") == 4 && os.str() == "42 x") {
+	 ++successful;
+      } else {
+	 print("FMT_PRINTF test for \"%%d %%s\" fails\n");
+      }
+   }
+   {
+      ++testcases;
+      std::ostringstream os;
+      if (FMT_PRINTF(os, "%*.*f", 8, 3, 3.25) == 8 &&
+	    os.str() == "   3.250") {
+	 ++successful;
+      } else {
+	 print("FMT_PRINTF test for \"%%*.*f\" fails\n");
+      }
+   }
+#if defined(__GNUC__)
+   {
+      using namespace fmt::literals;
+      ++testcases;
+      std::ostringstream os;
+      if ("%10.3f"_fmt(os, 3.25) == 10 && os.str() == "     3.250") {
+	 ++successful;
+      } else {
+	 print("_fmt literal test for \"%%10.3f\" fails\n");
+      }
+   }
+#endif
+#endif
+
    /* some testcases for fmt::snprintf */
    char s[] = "Hello, world!";
    for (int len = 0; len < static_cast<int>(sizeof(s)) + 1; ++len) {
       testcase_for_snprintf(len, "%s", s);
    }
+   for (int len = 0; len < 20; ++len) {
+      testcase_for_snprintf(len, "%d %8.2f %s", 42, 3.25, "ok");
+   }
+   /* wide variant of fmt::snprintf; we test just with
+      sufficiently large buffers as std::swprintf returns -1
+      in case of truncations */
+   wchar_t ws[] = L"Hello, world!";
+   testcase_for_snprintf(sizeof(ws)/sizeof(ws[0]), L"%ls", ws);
+   testcase_for_snprintf(sizeof(ws)/sizeof(ws[0]) + 1, L"%ls", ws);
+
+   /* some testcases for fmt::sprintf */
+   sprintf_testcase("Hello, world!");
+   sprintf_testcase("%s", s);
+   sprintf_testcase("%d %8.2f %s", 42, 3.25, "ok");
+   /* results beyond the internal small buffer must spill correctly */
+   sprintf_testcase("%0200d", 7);
+   /* invalid formats must deliver an empty string */
+   sprintf_testcase("%q");
+   sprintf_testcase(L"%ls %d", ws, 42);
+
+   /* some testcases for fmt::format_to */
+   {
+      ++testcases;
+      char frame[64];
+      auto res = fmt::format_to(frame, "%d %8.2f %s", 42, 3.25, "ok");
+      std::string expected = fmt::sprintf("%d %8.2f %s", 42, 3.25, "ok");
+      if (res.count >= 0 &&
+	    res.out == frame + expected.size() &&
+	    std::string(frame, res.count) == expected) {
+	 ++successful;
+      } else {
+	 print("fmt::format_to test into a char array fails\n");
+      }
+   }
+   {
+      ++testcases;
+      std::string text;
+      auto res = fmt::format_to(std::back_inserter(text), "%-10s|%05d|",
+	 "left", 17);
+      if (res.count >= 0 && text == "left      |00017|") {
+	 ++successful;
+      } else {
+	 print("fmt::format_to test with a back inserter fails\n");
+      }
+   }
+   {
+      ++testcases;
+      std::wstring wtext;
+      auto res = fmt::format_to(std::back_inserter(wtext), L"%ls %d", ws, 42);
+      if (res.count >= 0 && wtext == L"Hello, world! 42") {
+	 ++successful;
+      } else {
+	 print("fmt::format_to test with a wide back inserter fails\n");
+      }
+   }
+   {
+      /* invalid formats must deliver -1 */
+      ++testcases;
+      std::string text;
+      auto res = fmt::format_to(std::back_inserter(text), "%q");
+      if (res.count == -1) {
+	 ++successful;
+      } else {
+	 print("fmt::format_to test with an invalid format fails\n");
+      }
+   }
+
+   /* some testcases for fmt::memory_stream */
+   {
+      ++testcases;
+      fmt::memory_stream<char> ms;
+      fmt::printf(ms, "%d %8.2f %s", 42, 3.25, "ok");
+      ms << " << works as well";
+      std::string expected = "42     3.25 ok << works as well";
+      if (std::string(ms.data(), ms.size()) == expected &&
+	    ms.str() == expected && ms.size() == 0) {
+	 ++successful;
+      } else {
+	 print("fmt::memory_stream test fails\n");
+      }
+   }
+   {
+      /* results beyond the inline buffer must spill correctly */
+      ++testcases;
+      fmt::memory_stream<char, 16> ms;
+      fmt::printf(ms, "%0200d", 7);
+      std::string expected = fmt::sprintf("%0200d", 7);
+      if (std::string(ms.data(), ms.size()) == expected &&
+	    ms.str() == expected) {
+	 ++successful;
+      } else {
+	 print("fmt::memory_stream spill test fails\n");
+      }
+   }
+   {
+      ++testcases;
+      fmt::memory_stream<wchar_t> wms;
+      fmt::printf(wms, L"%ls %d", ws, 42);
+      if (wms.str() == L"Hello, world! 42") {
+	 ++successful;
+      } else {
+	 print("wide fmt::memory_stream test fails\n");
+      }
+   }
+
+   /* some testcases for fmt::printf_cached; the format strings
+      are assembled at runtime such that repeated calls hit the
+      cache through different pointers */
+   {
+      ++testcases;
+      std::string catalog_format = std::string("%d %8.2f %") + "s\n";
+      bool ok = true;
+      for (int i = 0; ok && i < 3; ++i) {
+	 std::string runtime_copy = catalog_format;
+	 std::ostringstream os1; std::ostringstream os2;
+	 int count1 = fmt::printf_cached(os1, runtime_copy.c_str(),
+	    i, i + 0.5, "cached");
+	 int count2 = fmt::printf(os2, catalog_format.c_str(),
+	    i, i + 0.5, "cached");
+	 ok = count1 == count2 && os1.str() == os2.str();
+      }
+      if (ok) {
+	 ++successful;
+      } else {
+	 print("fmt::printf_cached test fails\n");
+      }
+   }
+   {
+      /* invalid formats must deliver -1, also on cache hits */
+      ++testcases;
+      std::ostringstream os;
+      if (fmt::printf_cached(os, "%q") == -1 &&
+	    fmt::printf_cached(os, "%q") == -1) {
+	 ++successful;
+      } else {
+	 print("fmt::printf_cached test with an invalid format fails\n");
+      }
+   }
+
+#if defined(__unix__)
+   /* some testcases for fmt::dprintf through a pipe */
+   {
+      ++testcases;
+      int fds[2];
+      bool ok = pipe(fds) == 0;
+      if (ok) {
+	 int count = fmt::dprintf(fds[1], "ts=%d level=%-5s msg=%s\n",
+	    4711, "info", "hello");
+	 int nbytes = 0;
+	 std::string expected = fmt::sprintf("ts=%d level=%-5s msg=%s\n",
+	    4711, "info", "hello");
+	 char buf[128];
+	 if (count > 0 && static_cast<std::size_t>(count) < sizeof buf) {
+	    nbytes = read(fds[0], buf, count);
+	 }
+	 ok = count == static_cast<int>(expected.size()) &&
+	    nbytes == count &&
+	    std::string(buf, nbytes) == expected &&
+	    fmt::dprintf(fds[1], "%q") == -1;
+	 close(fds[0]); close(fds[1]);
+      }
+      if (ok) {
+	 ++successful;
+      } else {
+	 print("fmt::dprintf test fails\n");
+      }
+   }
+   {
+      /* %n must see the gathered literals as well */
+      ++testcases;
+      int fds[2];
+      bool ok = pipe(fds) == 0;
+      if (ok) {
+	 int offset = 0;
+	 int count = fmt::dprintf(fds[1], "abc%d%ndef\n", 42, &offset);
+	 char buf[16];
+	 ok = count == 9 && offset == 5 &&
+	    read(fds[0], buf, count) == count;
+	 close(fds[0]); close(fds[1]);
+      }
+      if (ok) {
+	 ++successful;
+      } else {
+	 print("fmt::dprintf test with %%n fails\n");
+      }
+   }
+#endif
+
+#ifdef FMT_PRINTF_STATS
+   /* testcase for the opt-in instrumentation layer */
+   {
+      ++testcases;
+      fmt::stats_reset();
+      std::ostringstream os;
+      fmt::printf(os, "%d %f %s %c\n", 42, 3.25, "text", 'x');
+      auto snapshot = fmt::stats();
+      if (snapshot.integer_conversions == 1 &&
+	    snapshot.float_conversions == 1 &&
+	    snapshot.string_conversions == 1 &&
+	    snapshot.char_conversions == 1 &&
+	    snapshot.bytes_written > 0) {
+	 ++successful;
+      } else {
+	 print("fmt::stats test fails\n");
+      }
+   }
+#endif
 
    fmt::printf("%u/%u tests succeeded\n", successful, testcases);
    if (warnings > 0) {
@@ -1282,4 +1906,7 @@ void run_tests() {
 
 int main() {
    run_tests();
+#ifdef FMT_TIMING
+   return perf_report();
+#endif
 }